@@ -14,7 +14,8 @@ wayland_scanner() {
 cflags() {
 	echo -g -std=c11 -pedantic -I. -fPIC \
 		-Wall -Werror=implicit-function-declaration -Werror=incompatible-pointer-types \
-		-D_POSIX_C_SOURCE=200809L -D_XOPEN_SOURCE=600 -DENABLE_XWAYLAND=1
+		-D_POSIX_C_SOURCE=200809L -D_XOPEN_SOURCE=600 -D_DEFAULT_SOURCE \
+		-DENABLE_XWAYLAND=1
 }
 
 [ ! -d "build" ] && mkdir build
@@ -26,4 +27,11 @@ wayland_scanner client-header stable/xdg-shell/xdg-shell.xml xdg-shell-client-pr
 
 cc $(cflags) -o build/waycraft waycraft/waycraft.c $(waycraft_libs) &
 cc $(cflags) -shared -o build/libgame.so build/stb_image.o waycraft/game.c -lm &
+
+# NOTE: the tests and benchmarks are optimized, since most of them measure
+# how fast the game code is.
+for test in tests/*.c; do
+	cc $(cflags) -O2 -o "build/test_$(basename "$test" .c)" "$test" \
+		build/stb_image.o -lm -lpthread &
+done
 wait
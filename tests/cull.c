@@ -0,0 +1,210 @@
+/*
+ * NOTE: checks that chunk_cull_faces finds the same faces as a loop that
+ * compares every block with its six neighbours, like the meshers did before
+ * they used bitmasks. The chunks are random blocks with random borders and
+ * generated terrain. Then measures the time per section of both.
+ */
+#include "tests/test.h"
+
+#define CULL_RANDOM_CHUNK_COUNT 400
+#define CULL_REPEAT_COUNT 20
+
+static u32 cull_sink;
+
+static u32
+random_next(u32 *state)
+{
+	*state = *state * 1664525 + 1013904223;
+	return *state >> 8;
+}
+
+// NOTE: mostly air, water and stone, so that many faces are hidden
+static u16
+random_block(u32 *state)
+{
+	u32 value = random_next(state) % 8;
+	if (value < 3) {
+		return BLOCK_AIR;
+	} else if (value < 5) {
+		return BLOCK_WATER;
+	} else if (value < 7) {
+		return BLOCK_STONE;
+	} else {
+		return 1 + random_next(state) % (BLOCK_COUNT - 1);
+	}
+}
+
+/*
+ * NOTE: the per-block loop. It fills the same masks as chunk_cull_faces,
+ * including the lowered water blocks and the hidden border faces.
+ */
+static void
+cull_faces_ref(const u16 *blocks, u16 (*borders)[CHUNK_BORDER_SIZE],
+    u32 section, struct chunk_face_masks *masks)
+{
+	memset(masks, 0, sizeof(*masks));
+
+	u32 section_start = section * CHUNK_SECTION_HEIGHT;
+	for (u32 i = 0; i < CHUNK_SECTION_SIZE; i++) {
+		i32 x = i % BLOCK_COUNT_X;
+		i32 j = i / BLOCK_COUNT_X % CHUNK_SECTION_HEIGHT;
+		i32 y = section_start + j;
+		i32 z = i / BLOCK_COUNT_X / CHUNK_SECTION_HEIGHT;
+
+		u32 block = blocks[block_index(x, y, z)];
+		if (block == BLOCK_AIR) {
+			continue;
+		}
+
+		u16 next[CHUNK_BORDER_COUNT];
+
+		next[CHUNK_BORDER_RIGHT] = x + 1 >= BLOCK_COUNT_X ?
+		    borders[CHUNK_BORDER_RIGHT][border_index(y, z)] :
+		    blocks[block_index(x + 1, y, z)];
+
+		next[CHUNK_BORDER_LEFT] = x - 1 < 0 ?
+		    borders[CHUNK_BORDER_LEFT][border_index(y, z)] :
+		    blocks[block_index(x - 1, y, z)];
+
+		next[CHUNK_BORDER_TOP] = y + 1 >= BLOCK_COUNT_Y ?
+		    borders[CHUNK_BORDER_TOP][border_index(x, z)] :
+		    blocks[block_index(x, y + 1, z)];
+
+		next[CHUNK_BORDER_BOTTOM] = y - 1 < 0 ?
+		    borders[CHUNK_BORDER_BOTTOM][border_index(x, z)] :
+		    blocks[block_index(x, y - 1, z)];
+
+		next[CHUNK_BORDER_FRONT] = z + 1 >= BLOCK_COUNT_Z ?
+		    borders[CHUNK_BORDER_FRONT][border_index(x, y)] :
+		    blocks[block_index(x, y, z + 1)];
+
+		next[CHUNK_BORDER_BACK] = z - 1 < 0 ?
+		    borders[CHUNK_BORDER_BACK][border_index(x, y)] :
+		    blocks[block_index(x, y, z - 1)];
+
+		bool is_border[CHUNK_BORDER_COUNT] = {
+			x + 1 >= BLOCK_COUNT_X, x == 0,
+			y + 1 >= BLOCK_COUNT_Y, y == 0,
+			z + 1 >= BLOCK_COUNT_Z, z == 0,
+		};
+
+		u32 (*is_empty)(enum block_type block) = block_is_empty;
+		if (block == BLOCK_WATER) {
+			is_empty = block_is_not_water;
+			if (next[CHUNK_BORDER_TOP] == BLOCK_AIR) {
+				masks->lowered[z][j] |= 1 << x;
+			}
+		}
+
+		for (u32 f = 0; f < CHUNK_BORDER_COUNT; f++) {
+			bool is_side = chunk_faces[f].normal != 1;
+			if (block == BLOCK_WATER && is_side) {
+				continue;
+			}
+
+			if (is_empty(next[f])) {
+				masks->visible[f][z][j] |= 1 << x;
+			} else if (is_border[f]) {
+				masks->hidden_border_count++;
+			}
+		}
+	}
+}
+
+// NOTE: returns the number of sections whose masks differ
+static u32
+cull_check_chunk(const u16 *blocks, u16 (*borders)[CHUNK_BORDER_SIZE])
+{
+	static struct chunk_face_masks expected, masks;
+
+	u32 error_count = 0;
+	for (u32 section = 0; section < CHUNK_SECTION_COUNT; section++) {
+		cull_faces_ref(blocks, borders, section, &expected);
+		chunk_cull_faces(blocks, borders, section, &masks);
+
+		bool is_equal = expected.hidden_border_count == masks.hidden_border_count &&
+		    memcmp(expected.visible, masks.visible, sizeof(masks.visible)) == 0 &&
+		    memcmp(expected.lowered, masks.lowered, sizeof(masks.lowered)) == 0;
+		error_count += !is_equal;
+	}
+
+	return error_count;
+}
+
+// NOTE: returns the time per section in microseconds
+static f64
+cull_benchmark_chunk(const u16 *blocks, u16 (*borders)[CHUNK_BORDER_SIZE],
+    bool is_reference)
+{
+	static struct chunk_face_masks masks;
+
+	f64 start_time = get_time_sec();
+	for (u32 k = 0; k < CULL_REPEAT_COUNT; k++) {
+		for (u32 section = 0; section < CHUNK_SECTION_COUNT; section++) {
+			if (is_reference) {
+				cull_faces_ref(blocks, borders, section, &masks);
+			} else {
+				chunk_cull_faces(blocks, borders, section, &masks);
+			}
+
+			cull_sink += masks.visible[k % CHUNK_BORDER_COUNT][0][0];
+		}
+	}
+
+	f64 time = get_time_sec() - start_time;
+	return time * 1e6 / (CULL_REPEAT_COUNT * CHUNK_SECTION_COUNT);
+}
+
+int
+main(void)
+{
+	static u16 blocks[BLOCK_COUNT];
+	static u16 borders[CHUNK_BORDER_COUNT][CHUNK_BORDER_SIZE];
+
+	u32 random_state = 1234;
+	u32 error_count = 0;
+	u32 chunk_counts[2] = {0};
+	f64 times[2][2] = {0};
+
+	for (u32 c = 0; c < CULL_RANDOM_CHUNK_COUNT; c++) {
+		for (u32 i = 0; i < BLOCK_COUNT; i++) {
+			blocks[i] = random_block(&random_state);
+		}
+
+		for (u32 f = 0; f < CHUNK_BORDER_COUNT; f++) {
+			for (u32 i = 0; i < CHUNK_BORDER_SIZE; i++) {
+				borders[f][i] = random_block(&random_state);
+			}
+		}
+
+		error_count += cull_check_chunk(blocks, borders);
+		times[0][0] += cull_benchmark_chunk(blocks, borders, true);
+		times[0][1] += cull_benchmark_chunk(blocks, borders, false);
+		chunk_counts[0]++;
+	}
+
+	for (i32 z = -4; z < 4; z++) {
+		for (i32 x = -4; x < 4; x++) {
+			for (i32 y = -3; y < 4; y++) {
+				if (test_generate_chunk(v3i(x, y, z), blocks, borders)) {
+					continue;
+				}
+
+				error_count += cull_check_chunk(blocks, borders);
+				times[1][0] += cull_benchmark_chunk(blocks, borders, true);
+				times[1][1] += cull_benchmark_chunk(blocks, borders, false);
+				chunk_counts[1]++;
+			}
+		}
+	}
+
+	const char *chunk_names[] = { "random", "generated" };
+	printf("chunks     count  per block  bitmask (us per section)\n");
+	for (u32 i = 0; i < 2; i++) {
+		printf("%-9s  %5u  %9.2f  %7.2f\n", chunk_names[i], chunk_counts[i],
+		    times[i][0] / chunk_counts[i], times[i][1] / chunk_counts[i]);
+	}
+
+	printf("%u mismatching sections (sink %u)\n", error_count, cull_sink);
+	return error_count != 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * NOTE: measures the vertex count, the index count and the time per chunk
+ * of the naive and the greedy mesher on generated terrain. Uniform chunks
+ * are skipped, since they are never meshed.
+ */
+#include "tests/test.h"
+
+#define MESH_REPEAT_COUNT 5
+
+int
+main(void)
+{
+	static u16 blocks[BLOCK_COUNT];
+	static u16 borders[CHUNK_BORDER_COUNT][CHUNK_BORDER_SIZE];
+
+	struct arena arena = arena_reserve(MB(64));
+	struct mesh_buffer mesh = mesh_buffer_init(&arena, BLOCK_COUNT * 4 * 6);
+
+	const char *mode_names[] = {
+		[CHUNK_MESH_NAIVE] = "naive",
+		[CHUNK_MESH_GREEDY] = "greedy",
+	};
+
+	u64 vertex_counts[2] = {0};
+	f64 times[2] = {0};
+	u32 chunk_count = 0;
+	u32 hidden_face_count = 0;
+	for (i32 z = -6; z < 6; z++) {
+		for (i32 x = -6; x < 6; x++) {
+			for (i32 y = -3; y < 4; y++) {
+				if (test_generate_chunk(v3i(x, y, z), blocks, borders)) {
+					continue;
+				}
+
+				chunk_count++;
+				for (u32 mode = 0; mode < 2; mode++) {
+					f64 start_time = get_time_sec();
+					for (u32 k = 0; k < MESH_REPEAT_COUNT; k++) {
+						mesh.vertex_count = 0;
+						for (u32 i = 0; i < CHUNK_SECTION_COUNT; i++) {
+							if (mode == CHUNK_MESH_GREEDY) {
+								chunk_mesh_greedy(blocks, borders, i, &mesh,
+								    &hidden_face_count);
+							} else {
+								chunk_mesh(blocks, borders, i, &mesh,
+								    &hidden_face_count);
+							}
+						}
+					}
+
+					times[mode] += (get_time_sec() - start_time) / MESH_REPEAT_COUNT;
+					vertex_counts[mode] += mesh.vertex_count;
+				}
+			}
+		}
+	}
+
+	printf("%.1f hidden border faces per chunk\n",
+	    (f64)hidden_face_count / (2 * MESH_REPEAT_COUNT * chunk_count));
+	printf("mode    chunks  vertices  indices  time (per chunk)\n");
+	for (u32 mode = 0; mode < 2; mode++) {
+		f64 vertex_count = (f64)vertex_counts[mode] / chunk_count;
+		printf("%-6s  %6u  %8.1f  %7.1f  %7.1f us\n", mode_names[mode],
+		    chunk_count, vertex_count, vertex_count / 4 * 6,
+		    times[mode] / chunk_count * 1e6);
+	}
+
+	return 0;
+}
@@ -0,0 +1,128 @@
+/*
+ * NOTE: checks that every kernel of perlin_noise_layered_x8 that the
+ * processor supports returns the same bits as perlin_noise_layered, over a
+ * grid of points at the noise sizes of the terrain and a few others. Then
+ * measures the throughput of each kernel in samples per second.
+ */
+#include "tests/test.h"
+
+#define NOISE_GRID_SIZE 128
+#define NOISE_BENCHMARK_COUNT 200000
+
+struct noise_kernel {
+	const char *name;
+	perlin_noise_layered_x8_t *kernel;
+	bool is_supported;
+};
+
+struct noise_params {
+	f32 size;
+	u32 octave_count;
+	f32 persistance;
+};
+
+static f32 noise_sink;
+
+// NOTE: returns the number of samples that differ from the scalar noise
+static u32
+noise_check_kernel(perlin_noise_layered_x8_t *kernel,
+    struct noise_params params, f32 y)
+{
+	u32 error_count = 0;
+	for (i32 z = -NOISE_GRID_SIZE; z < NOISE_GRID_SIZE; z++) {
+		for (i32 x0 = -NOISE_GRID_SIZE; x0 < NOISE_GRID_SIZE; x0 += 8) {
+			v3 points[8];
+			for (i32 i = 0; i < 8; i++) {
+				points[i] = mulf(v3(x0 + i, y, z), params.size);
+			}
+
+			f32 values[8];
+			kernel(points, params.octave_count, params.persistance, values);
+			for (u32 i = 0; i < 8; i++) {
+				f32 expected = perlin_noise_layered(points[i],
+				    params.octave_count, params.persistance);
+				error_count += memcmp(&expected, &values[i], sizeof(f32)) != 0;
+			}
+		}
+	}
+
+	return error_count;
+}
+
+// NOTE: returns the number of samples per second
+static f64
+noise_benchmark_kernel(perlin_noise_layered_x8_t *kernel)
+{
+	v3 points[8];
+	for (u32 i = 0; i < 8; i++) {
+		points[i] = v3(i * 0.02f, 0, 0);
+	}
+
+	f64 start_time = get_time_sec();
+	for (u32 k = 0; k < NOISE_BENCHMARK_COUNT; k++) {
+		f32 values[8];
+		kernel(points, 8, 0.5f, values);
+		noise_sink += values[k % 8];
+		for (u32 i = 0; i < 8; i++) {
+			points[i].z += 0.02f;
+		}
+	}
+
+	f64 time = get_time_sec() - start_time;
+	return NOISE_BENCHMARK_COUNT * 8 / time;
+}
+
+int
+main(void)
+{
+	struct noise_kernel kernels[] = {
+		{ "scalar", perlin_noise_layered_x8_scalar, true },
+#if NOISE_X86
+		{ "sse4.1", perlin_noise_layered_x8_sse4, false },
+		{ "avx2",   perlin_noise_layered_x8_avx2,  false },
+#endif
+	};
+
+#if NOISE_X86
+	__builtin_cpu_init();
+	perlin_noise_hash32_init();
+	kernels[1].is_supported = __builtin_cpu_supports("sse4.1");
+	kernels[2].is_supported = __builtin_cpu_supports("avx2");
+#endif
+
+	// NOTE: the first two are the noise of the terrain heights
+	struct noise_params params[] = {
+		{ 0.02f,   8, 0.5f },
+		{ 0.0005f, 8, 0.8f },
+		{ 0.1f,    1, 0.5f },
+		{ 1.37f,   4, 0.3f },
+		{ 12.5f,   3, 0.9f },
+	};
+
+	f32 ys[] = { 0.0f, -3.7f, 1000.25f };
+
+	u32 error_count = 0;
+	for (u32 k = 0; k < LENGTH(kernels); k++) {
+		struct noise_kernel *kernel = &kernels[k];
+		if (!kernel->is_supported) {
+			printf("%-6s  not supported\n", kernel->name);
+			continue;
+		}
+
+		u32 kernel_error_count = 0;
+		for (u32 p = 0; p < LENGTH(params); p++) {
+			for (u32 y = 0; y < LENGTH(ys); y++) {
+				kernel_error_count += noise_check_kernel(kernel->kernel,
+				    params[p], ys[y]);
+			}
+		}
+
+		f64 samples_per_sec = noise_benchmark_kernel(kernel->kernel);
+		printf("%-6s  %u mismatching samples, %.2fM samples/s\n",
+		    kernel->name, kernel_error_count, samples_per_sec * 1e-6);
+		error_count += kernel_error_count;
+	}
+
+	printf("%u errors (sink %f)\n", error_count, noise_sink);
+	return error_count != 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * NOTE: measures how long it takes to read, write and pack the blocks of a
+ * chunk with bit-packed palette indices, compared to an array with one
+ * block per element. The chunks contain random blocks from palettes of
+ * different sizes. Also checks that packing and setting blocks keeps the
+ * blocks intact.
+ */
+#include "tests/test.h"
+
+#define PALETTE_REPEAT_COUNT 2000
+
+static u32 palette_sink;
+
+static u32
+random_next(u32 *state)
+{
+	*state = *state * 1664525 + 1013904223;
+	return *state >> 8;
+}
+
+// NOTE: returns the time per block in nanoseconds
+static f64
+get_block_time(f64 start_time)
+{
+	f64 time = get_time_sec() - start_time;
+	return time * 1e9 / ((f64)PALETTE_REPEAT_COUNT * BLOCK_COUNT);
+}
+
+int
+main(void)
+{
+	static u16 blocks[BLOCK_COUNT];
+	static u16 unpacked[BLOCK_COUNT];
+	static u16 flat[BLOCK_COUNT];
+
+	struct arena arena = arena_reserve(MB(64));
+	struct world world = {0};
+	world.arena = &arena;
+
+	u32 error_count = 0;
+	u32 random_state = 1234;
+	u32 palette_counts[] = { 2, 4, 16 };
+	printf("palette  bits  flat read  chunk_at  unpack  flat write"
+	    "  set block  pack  widen (ns per block)\n");
+	for (u32 p = 0; p < LENGTH(palette_counts); p++) {
+		u32 palette_count = palette_counts[p];
+		for (u32 i = 0; i < BLOCK_COUNT; i++) {
+			blocks[i] = random_next(&random_state) % palette_count;
+		}
+
+		// NOTE: every block of the palette has to occur at least once
+		for (u32 i = 0; i < palette_count; i++) {
+			blocks[i] = i;
+		}
+
+		struct chunk chunk = {0};
+		if (!chunk_pack(&world, &chunk, blocks)) {
+			printf("failed to pack the chunk\n");
+			return 1;
+		}
+
+		chunk_unpack(&chunk, unpacked);
+		error_count += memcmp(blocks, unpacked, sizeof(blocks)) != 0;
+		memcpy(flat, blocks, sizeof(flat));
+
+		f64 start_time = get_time_sec();
+		for (u32 k = 0; k < PALETTE_REPEAT_COUNT; k++) {
+			for (u32 z = 0; z < BLOCK_COUNT_Z; z++) {
+				for (u32 y = 0; y < BLOCK_COUNT_Y; y++) {
+					for (u32 x = 0; x < BLOCK_COUNT_X; x++) {
+						palette_sink += flat[block_index(x, y, z)];
+					}
+				}
+			}
+		}
+
+		f64 flat_read_time = get_block_time(start_time);
+
+		start_time = get_time_sec();
+		for (u32 k = 0; k < PALETTE_REPEAT_COUNT; k++) {
+			for (u32 z = 0; z < BLOCK_COUNT_Z; z++) {
+				for (u32 y = 0; y < BLOCK_COUNT_Y; y++) {
+					for (u32 x = 0; x < BLOCK_COUNT_X; x++) {
+						palette_sink += chunk_at(&chunk, x, y, z);
+					}
+				}
+			}
+		}
+
+		f64 read_time = get_block_time(start_time);
+
+		start_time = get_time_sec();
+		for (u32 k = 0; k < PALETTE_REPEAT_COUNT; k++) {
+			chunk_unpack(&chunk, unpacked);
+			palette_sink += unpacked[k % BLOCK_COUNT];
+		}
+
+		f64 unpack_time = get_block_time(start_time);
+
+		start_time = get_time_sec();
+		for (u32 k = 0; k < PALETTE_REPEAT_COUNT; k++) {
+			for (u32 i = 0; i < BLOCK_COUNT; i++) {
+				flat[i] = blocks[(i + k) % BLOCK_COUNT];
+			}
+
+			palette_sink += flat[k % BLOCK_COUNT];
+		}
+
+		f64 flat_write_time = get_block_time(start_time);
+
+		start_time = get_time_sec();
+		for (u32 k = 0; k < PALETTE_REPEAT_COUNT; k++) {
+			for (u32 i = 0; i < BLOCK_COUNT; i++) {
+				chunk_set_block(&world, &chunk, i, blocks[(i + k) % BLOCK_COUNT]);
+			}
+		}
+
+		f64 write_time = get_block_time(start_time);
+
+		chunk_unpack(&chunk, unpacked);
+		error_count += memcmp(flat, unpacked, sizeof(flat)) != 0;
+
+		start_time = get_time_sec();
+		for (u32 k = 0; k < PALETTE_REPEAT_COUNT; k++) {
+			chunk_pack(&world, &chunk, blocks);
+		}
+
+		f64 pack_time = get_block_time(start_time);
+
+		chunk_unpack(&chunk, unpacked);
+		error_count += memcmp(blocks, unpacked, sizeof(blocks)) != 0;
+
+		u32 bits_per_block = chunk.bits_per_block;
+		start_time = get_time_sec();
+		for (u32 k = 0; k < PALETTE_REPEAT_COUNT; k++) {
+			chunk_widen(&world, &chunk, 8);
+			chunk_widen(&world, &chunk, bits_per_block);
+		}
+
+		f64 widen_time = get_block_time(start_time) / 2;
+
+		chunk_unpack(&chunk, unpacked);
+		error_count += memcmp(blocks, unpacked, sizeof(blocks)) != 0;
+
+		printf("%7u  %4u  %9.2f  %8.2f  %6.2f  %10.2f  %9.2f  %4.2f  %5.2f\n",
+		    palette_count, bits_per_block, flat_read_time, read_time,
+		    unpack_time, flat_write_time, write_time, pack_time, widen_time);
+	}
+
+	printf("block memory %lu bytes, %u errors (sink %u)\n",
+	    (unsigned long)world.block_memory, error_count, palette_sink);
+	return error_count != 0;
+}
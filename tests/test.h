@@ -0,0 +1,227 @@
+/*
+ * NOTE: the tests and benchmarks include the game code directly and replace
+ * the OpenGL functions with stubs, so that they run without a display. The
+ * stubs only keep enough state for the renderer to work, nothing is drawn.
+ * The helpers are inline, since each test only uses some of them.
+ */
+#include <sys/sysinfo.h>
+
+#include "waycraft/game.c"
+#include "waycraft/task.c"
+
+#define TEST_ARENA_SIZE MB(2048)
+#define TEST_FRAME_ARENA_SIZE MB(64)
+
+struct test_context {
+	struct platform_task_queue queue;
+	struct platform_api platform;
+	struct arena arena;
+	struct arena frame_arena;
+	struct renderer renderer;
+	struct game_assets assets;
+};
+
+static u32 stub_next_name = 1;
+static void *stub_mapped_buffers[2];
+
+static void
+stub_gl_void(void)
+{
+}
+
+static void
+stub_gl_gen(GLsizei count, GLuint *names)
+{
+	while (count-- > 0) {
+		*names++ = stub_next_name++;
+	}
+}
+
+static GLuint
+stub_gl_create_program(void)
+{
+	return stub_next_name++;
+}
+
+static GLuint
+stub_gl_create_shader(GLenum type)
+{
+	return stub_next_name++;
+}
+
+static void
+stub_gl_get_status(GLuint name, GLenum parameter, GLint *value)
+{
+	*value = 1;
+}
+
+static GLint
+stub_gl_get_uniform_location(GLuint program, const GLchar *name)
+{
+	return 0;
+}
+
+static void
+stub_gl_get_integer(GLenum parameter, GLint *value)
+{
+	*value = 0;
+}
+
+static GLenum
+stub_gl_get_error(void)
+{
+	return GL_NO_ERROR;
+}
+
+static void *
+stub_gl_map_buffer_range(GLenum target, GLintptr offset, GLsizeiptr length,
+    GLbitfield access)
+{
+	u32 i = target == GL_ELEMENT_ARRAY_BUFFER;
+	stub_mapped_buffers[i] = realloc(stub_mapped_buffers[i], length);
+	return stub_mapped_buffers[i];
+}
+
+static GLboolean
+stub_gl_unmap_buffer(GLenum target)
+{
+	return GL_TRUE;
+}
+
+static GLenum
+stub_gl_client_wait_sync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+	return GL_ALREADY_SIGNALED;
+}
+
+static inline void
+stub_gl_init(void)
+{
+#define X(name) gl.name = (gl##name##_t *)stub_gl_void;
+	OPENGL_MAP_FUNCTIONS()
+#undef X
+
+	gl.GenBuffers = stub_gl_gen;
+	gl.GenVertexArrays = stub_gl_gen;
+	gl.GenTextures = stub_gl_gen;
+	gl.CreateProgram = stub_gl_create_program;
+	gl.CreateShader = stub_gl_create_shader;
+	gl.GetShaderiv = stub_gl_get_status;
+	gl.GetProgramiv = stub_gl_get_status;
+	gl.GetUniformLocation = stub_gl_get_uniform_location;
+	gl.GetIntegerv = stub_gl_get_integer;
+	gl.GetError = stub_gl_get_error;
+	gl.MapBufferRange = stub_gl_map_buffer_range;
+	gl.UnmapBuffer = stub_gl_unmap_buffer;
+	gl.ClientWaitSync = stub_gl_client_wait_sync;
+}
+
+static inline void
+test_init(struct test_context *test)
+{
+	u32 thread_count = MAX(get_nprocs(), 2);
+	task_queue_init(&test->queue, thread_count);
+
+	struct platform_api *platform = &test->platform;
+	platform->add_task = add_task;
+	platform->add_child_task = add_child_task;
+	platform->wait_task = wait_task;
+	platform->parallel_for = parallel_for;
+	platform->complete_all_tasks = complete_all_tasks;
+	platform->set_background_quota = set_background_quota;
+	platform->get_task_stats = get_task_stats;
+	platform->get_scratch_stats = get_scratch_stats;
+	platform->queue = &test->queue;
+
+	stub_gl_init();
+	test->arena = arena_reserve(TEST_ARENA_SIZE);
+	assert(test->arena.data);
+	test->frame_arena = arena_create(TEST_FRAME_ARENA_SIZE, &test->arena);
+	test->renderer = renderer_init(&test->arena);
+}
+
+// NOTE: updates the world like a frame of the game, without drawing it
+static inline void
+test_update_world(struct test_context *test, struct world *world, v3 position,
+    v3 direction)
+{
+	task_queue_begin_frame(&test->queue);
+	arena_reset(&test->frame_arena);
+	renderer_begin_frame(&test->renderer);
+	struct render_cmdbuf cmd_buffer = render_cmdbuf_init(&test->renderer,
+	    &test->frame_arena, MB(8), 4 * 1024, 6 * 1024);
+	cmd_buffer.assets = &test->assets;
+	world_update(world, position, direction, &test->renderer, &cmd_buffer,
+	    &test->assets);
+}
+
+// NOTE: updates the world until every chunk around the position is ready,
+// returns the number of frames.
+static inline u32
+test_load_world(struct test_context *test, struct world *world, v3 position,
+    v3 direction)
+{
+	u32 frame_count = 0;
+	for (;;) {
+		test_update_world(test, world, position, direction);
+		frame_count++;
+
+		u32 ready_count = 0;
+		for (u32 i = 0; i < world->chunk_count; i++) {
+			ready_count += world->chunks[i].state == CHUNK_READY;
+		}
+
+		if (frame_count > 20 && ready_count == world->chunk_count) {
+			break;
+		}
+	}
+
+	complete_all_tasks(&test->queue);
+	return frame_count;
+}
+
+// NOTE: generates the blocks of the chunk at the coordinate from the
+// terrain, returns true if the chunk is uniform.
+static inline bool
+test_generate_blocks(v3i coord, u16 *blocks)
+{
+	struct chunk_column column = {0};
+	column.coord = coord;
+	column_compute_heights(&column);
+
+	bool is_uniform = chunk_generate(&column, coord, blocks);
+	if (is_uniform) {
+		for (u32 i = 1; i < BLOCK_COUNT; i++) {
+			blocks[i] = blocks[0];
+		}
+	}
+
+	return is_uniform;
+}
+
+// NOTE: also generates the neighbours of the chunk and copies their borders
+static inline bool
+test_generate_chunk(v3i coord, u16 *blocks, u16 (*borders)[CHUNK_BORDER_SIZE])
+{
+	static u16 neighbor_blocks[BLOCK_COUNT];
+
+	for (u32 i = 0; i < CHUNK_BORDER_COUNT; i++) {
+		u32 axis = i / 2;
+		v3i neighbor_coord = coord;
+		neighbor_coord.e[axis] += i & 1 ? -1 : 1;
+		test_generate_blocks(neighbor_coord, neighbor_blocks);
+
+		u32 a_axis = axis == 0 ? 1 : 0;
+		u32 b_axis = axis == 2 ? 1 : 2;
+		i32 p[3];
+		p[axis] = i & 1 ? BLOCK_COUNT_X - 1 : 0;
+		for (p[b_axis] = 0; p[b_axis] < BLOCK_COUNT_X; p[b_axis]++) {
+			for (p[a_axis] = 0; p[a_axis] < BLOCK_COUNT_X; p[a_axis]++) {
+				u32 j = border_index(p[a_axis], p[b_axis]);
+				borders[i][j] = neighbor_blocks[block_index(p[0], p[1], p[2])];
+			}
+		}
+	}
+
+	return test_generate_blocks(coord, blocks);
+}
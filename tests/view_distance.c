@@ -0,0 +1,33 @@
+/*
+ * NOTE: measures the block memory of the world after loading every chunk
+ * around a stationary player at increasing view distances.
+ */
+#include "tests/test.h"
+
+int
+main(void)
+{
+	struct test_context test = {0};
+	test_init(&test);
+
+	struct world world = world_init(&test.arena, &test.platform);
+	v3 position = v3(0, 20, 0);
+	v3 direction = v3(1, 0, 0);
+
+	i32 view_distances[] = { 2, 4, 8, 12, 16 };
+	printf("radius  chunks  block memory  used block memory  load time\n");
+	for (u32 i = 0; i < LENGTH(view_distances); i++) {
+		world_set_view_distance(&world, view_distances[i]);
+
+		f64 start_time = get_time_sec();
+		test_load_world(&test, &world, position, direction);
+		f64 load_time = get_time_sec() - start_time;
+
+		printf("%6d  %6u  %8.1f MiB  %13.1f MiB  %7.2f s\n",
+		    world.view_distance, world.chunk_count,
+		    world.block_memory / (1024.0 * 1024.0),
+		    world.used_block_memory / (1024.0 * 1024.0), load_time);
+	}
+
+	return 0;
+}
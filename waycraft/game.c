@@ -409,7 +409,7 @@ game_init(struct platform_memory *memory)
 	game->frame_arena = arena_create(MB(64), arena);
 
 	debug_init();
-	game->world = world_init(arena);
+	game->world = world_init(arena, memory->platform);
 	game->player = player_init(&game->camera);
 	game->renderer = renderer_init(arena);
 }
@@ -496,7 +496,8 @@ player_move(struct game_state *game, struct game_input *input)
 	v3 player_pos = player->position;
 	struct chunk *chunk = world_get_chunk(world, player_pos.x, player_pos.y,
 	    player_pos.z);
-	if (!chunk || chunk->state != CHUNK_READY) {
+	// NOTE: the player can only move once the chunk has been generated
+	if (!chunk || chunk->palette_count == 0) {
 		return;
 	}
 
@@ -790,8 +791,101 @@ window_find(struct game_window *window, u32 window_count,
 }
 
 static void
-game_finish(struct game_state *game)
+log_arena_stats(const char *name, const struct arena *arena)
 {
+	struct arena_stats stats = arena_get_stats(arena);
+	log_info("%s: %lu of %lu bytes used, %lu bytes peak, %lu allocations",
+	    name, (unsigned long)stats.used, (unsigned long)stats.size,
+	    (unsigned long)stats.peak, (unsigned long)stats.allocation_count);
+}
+
+// NOTE: only the first threads are logged if there are more
+static void
+log_scratch_stats(struct platform_api *platform)
+{
+	struct platform_scratch_stats stats[64];
+	u32 worker_count = platform->get_scratch_stats(platform->queue, stats,
+	    LENGTH(stats));
+	for (u32 i = 0; i < MIN(worker_count, LENGTH(stats)); i++) {
+		log_info("worker %u scratch: %lu of %lu bytes peak", i,
+		    (unsigned long)stats[i].high_water, (unsigned long)stats[i].size);
+	}
+}
+
+static const char *chunk_stage_names[CHUNK_STAGE_COUNT] = {
+	[CHUNK_STAGE_GENERATE] = "generate",
+	[CHUNK_STAGE_MESH]     = "mesh",
+	[CHUNK_STAGE_UPLOAD]   = "upload",
+};
+
+static const char *task_priority_names[PLATFORM_TASK_PRIORITY_COUNT] = {
+	[PLATFORM_TASK_FRAME]       = "frame",
+	[PLATFORM_TASK_INTERACTIVE] = "interactive",
+	[PLATFORM_TASK_BACKGROUND]  = "background",
+};
+
+static void
+game_log_stats(struct game_state *game, struct platform_api *platform)
+{
+	struct world *world = &game->world;
+	log_info("world: %u chunks, %u regenerated in the last minute",
+	    world->chunk_count, world->regenerated_per_minute);
+	log_info("last frame: %u chunks drawn, %u outside the frustum, %u in the fog, "
+	    "%u occluded", world->drawn_chunk_count,
+	    world->frustum_culled_chunk_count, world->fog_culled_chunk_count,
+	    world->occluded_chunk_count);
+
+	struct render_stats *render_stats = &game->renderer.stats;
+	log_info("last frame: %u commands, %u draw calls, %u state changes, "
+	    "%u skipped state changes", render_stats->command_count,
+	    render_stats->draw_call_count, render_stats->state_change_count,
+	    render_stats->skipped_state_change_count);
+
+	if (world->meshed_chunk_count > 0) {
+		log_info("meshing: %u chunks, %.1f hidden border faces per chunk",
+		    world->meshed_chunk_count,
+		    (f64)world->hidden_face_count / world->meshed_chunk_count);
+	}
+
+	struct mesh_stats mesh_stats = renderer_get_mesh_stats(&game->renderer);
+	log_info("meshes: %u meshes, %.1f of %.1f MiB used, %u free ranges, "
+	    "%.1f%% fragmentation", mesh_stats.mesh_count,
+	    mesh_stats.used / (1024.0 * 1024.0), mesh_stats.size / (1024.0 * 1024.0),
+	    mesh_stats.free_range_count, mesh_stats.fragmentation * 100.0f);
+
+	for (u32 i = 0; i < CHUNK_STAGE_COUNT; i++) {
+		struct chunk_stage_stats *stats = &world->stages[i];
+		log_info("%s: budget %.3f ms, cost %.3f ms, worker cost %.3f ms, "
+		    "limit %u chunks", chunk_stage_names[i], stats->budget,
+		    stats->cost, stats->worker_cost, stats->limit);
+	}
+
+	struct platform_task_stats task_stats[PLATFORM_TASK_PRIORITY_COUNT];
+	platform->get_task_stats(platform->queue, task_stats);
+	for (u32 i = 0; i < PLATFORM_TASK_PRIORITY_COUNT; i++) {
+		struct platform_task_stats *stats = &task_stats[i];
+		f64 average_latency = 0;
+		if (stats->executed_count > 0) {
+			average_latency = stats->total_latency / stats->executed_count;
+		}
+
+		log_info("%s tasks: %u queued, %lu executed, latency %.3f ms average, "
+		    "%.3f ms max", task_priority_names[i], stats->queued_count,
+		    (unsigned long)stats->executed_count, average_latency * 1000,
+		    stats->max_latency * 1000);
+	}
+}
+
+static void
+game_finish(struct game_state *game, struct platform_api *platform)
+{
+	// NOTE: the peaks show how large the arenas have to be
+	if (game->is_stats_enabled) {
+		log_arena_stats("arena", &game->arena);
+		log_arena_stats("frame arena", &game->frame_arena);
+		log_scratch_stats(platform);
+	}
+
 	renderer_finish(&game->renderer);
 }
 
@@ -812,8 +906,9 @@ game_update(struct platform_memory *memory, struct game_input *input,
 	}
 
 	// NOTE: reset the frame arena
-	game->frame_arena.used = 0;
+	arena_reset(&game->frame_arena);
 	debug_update(&game->frame_arena);
+	renderer_begin_frame(&game->renderer);
 
 	m4x4 projection = camera_get_projection(camera);
 	m4x4 view = camera_get_view(camera);
@@ -822,7 +917,7 @@ game_update(struct platform_memory *memory, struct game_input *input,
 	v3 camera_front = camera->direction;
 
 	u32 max_quad_count = 1024;
-	struct render_cmdbuf cmd_buffer = render_cmdbuf_init(
+	struct render_cmdbuf cmd_buffer = render_cmdbuf_init(&game->renderer,
 	    &game->frame_arena, MB(8), 4 * max_quad_count, 6 * max_quad_count);
 	cmd_buffer.mode = RENDER_3D;
 	cmd_buffer.assets = &game->assets;
@@ -831,7 +926,7 @@ game_update(struct platform_memory *memory, struct game_input *input,
 	cmd_buffer.transform.camera_pos = camera_pos;
 	cmd_buffer.transform.viewport = v2(input->width, input->height);
 
-	struct render_cmdbuf ui_cmd_buffer = render_cmdbuf_init(
+	struct render_cmdbuf ui_cmd_buffer = render_cmdbuf_init(&game->renderer,
 	    &game->frame_arena, KB(64), 4 * 128, 6 * 128);
 	ui_cmd_buffer.mode = RENDER_2D;
 	ui_cmd_buffer.assets = &game->assets;
@@ -948,6 +1043,39 @@ game_update(struct platform_memory *memory, struct game_input *input,
 			player->inventory.is_active = 1;
 		}
 
+		if (button_was_pressed(input->controller.toggle_mesh_mode)) {
+			u32 mesh_mode = world->mesh_mode == CHUNK_MESH_GREEDY ?
+			    CHUNK_MESH_NAIVE : CHUNK_MESH_GREEDY;
+			world_set_mesh_mode(world, mesh_mode);
+		}
+
+		i32 view_distance_change =
+		    button_was_pressed(input->controller.increase_view_distance) -
+		    button_was_pressed(input->controller.decrease_view_distance);
+		if (view_distance_change) {
+			world_set_view_distance(world,
+			    world->view_distance + view_distance_change);
+			log_info("view distance: %d chunks", world->view_distance);
+		}
+
+		if (button_was_pressed(input->controller.toggle_stats)) {
+			game->is_stats_enabled = !game->is_stats_enabled;
+			game->stats_time = GAME_STATS_INTERVAL;
+		}
+
+		i32 load_budget_change =
+		    button_was_pressed(input->controller.increase_load_budget) -
+		    button_was_pressed(input->controller.decrease_load_budget);
+		if (load_budget_change) {
+			f32 scale = load_budget_change > 0 ? 2.0f : 0.5f;
+			for (u32 i = 0; i < CHUNK_STAGE_COUNT; i++) {
+				world_set_stage_budget(world, i,
+				    scale * world->stages[i].budget);
+				log_info("%s budget: %.3f ms", chunk_stage_names[i],
+				    world->stages[i].budget);
+			}
+		}
+
 		game->hot_window = hot_window;
 	} else if (inventory_is_active) {
 		if (button_was_pressed(input->controller.toggle_inventory)) {
@@ -956,7 +1084,7 @@ game_update(struct platform_memory *memory, struct game_input *input,
 	}
 
 	world_update(&game->world, game->camera.position, game->camera.direction,
-	    &game->renderer, &cmd_buffer, &game->frame_arena, &game->assets);
+	    &game->renderer, &cmd_buffer, &game->assets);
 	window_manager_render(wm, view, projection, &cmd_buffer);
 
 	if (focused_window) {
@@ -1033,7 +1161,13 @@ game_update(struct platform_memory *memory, struct game_input *input,
 
 	debug_render(view, projection);
 
+	game->stats_time += input->dt;
+	if (game->is_stats_enabled && game->stats_time >= GAME_STATS_INTERVAL) {
+		game_log_stats(game, memory->platform);
+		game->stats_time = 0;
+	}
+
 	if (memory->is_done) {
-		game_finish(game);
+		game_finish(game, memory->platform);
 	}
 }
@@ -85,6 +85,10 @@ struct game_assets {
 	struct texture textures[TEXTURE_COUNT];
 };
 
+// NOTE: the interval in seconds at which the game logs its statistics, the
+// statistics are only logged once they are toggled on.
+#define GAME_STATS_INTERVAL 10.0f
+
 struct game_state {
 	struct world world;
 	struct camera camera;
@@ -102,6 +106,8 @@ struct game_state {
 	v2 cursor_pos;
 
 	u32 cursor;
+	f32 stats_time;
+	bool is_stats_enabled;
 };
 
 static struct texture get_texture(struct game_assets *assets, u32 texture_id);
@@ -113,7 +119,7 @@ button_was_pressed(u8 button)
 	return result;
 }
 
-static bool
+static inline bool
 button_was_released(u8 button)
 {
 	bool result = (button & 3) == 2;
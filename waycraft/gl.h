@@ -9,10 +9,20 @@ typedef void glBindBuffer_t(GLenum target, GLuint buffer);
 typedef void glDeleteBuffers_t(GLsizei n, const GLuint *buffers);
 typedef void glBufferData_t(GLenum target, GLsizeiptr size, const void *data, GLenum usage);
 typedef void glBufferSubData_t(GLenum target, GLintptr offset, GLsizeiptr size, const void *data);
+typedef void glBufferStorage_t(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+typedef void *glMapBufferRange_t(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean glUnmapBuffer_t(GLenum target);
+typedef GLsync glFenceSync_t(GLenum condition, GLbitfield flags);
+typedef GLenum glClientWaitSync_t(GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void glDeleteSync_t(GLsync sync);
+typedef void glGetIntegerv_t(GLenum pname, GLint *data);
+typedef const GLubyte *glGetStringi_t(GLenum name, GLuint index);
+typedef void glCopyBufferSubData_t(GLenum read_target, GLenum write_target, GLintptr read_offset, GLintptr write_offset, GLsizeiptr size);
 typedef void glGenVertexArrays_t(GLsizei n, GLuint *arrays);
 typedef void glDeleteVertexArrays_t(GLsizei n, const GLuint *arrays);
 typedef void glBindVertexArray_t(GLuint array);
 typedef void glVertexAttribPointer_t(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer);
+typedef void glVertexAttribIPointer_t(GLuint index, GLint size, GLenum type, GLsizei stride, const void *pointer);
 typedef void glEnableVertexAttribArray_t(GLuint index);
 typedef GLuint glCreateShader_t(GLenum type);
 typedef void glShaderSource_t(GLuint shader, GLsizei count, const GLchar *const *string, const GLint *length);
@@ -29,6 +39,7 @@ typedef void glUseProgram_t(GLuint program);
 typedef void glDeleteProgram_t(GLuint program);
 typedef void glDrawArrays_t(GLenum mode, GLint first, GLsizei count);
 typedef void glDrawElements_t(GLenum mode, GLsizei count, GLenum type, const void *indices);
+typedef void glDrawElementsBaseVertex_t(GLenum mode, GLsizei count, GLenum type, const void *indices, GLint basevertex);
 typedef void glGenTextures_t(GLsizei n, GLuint *textures);
 typedef void glTexImage2D_t(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels);
 typedef void glDeleteTextures_t(GLsizei n, const GLuint *textures);
@@ -61,10 +72,20 @@ typedef GLenum glGetError_t(void);
     X(DeleteBuffers) \
     X(BufferData) \
     X(BufferSubData) \
+    X(CopyBufferSubData) \
+    X(BufferStorage) \
+    X(MapBufferRange) \
+    X(UnmapBuffer) \
+    X(FenceSync) \
+    X(ClientWaitSync) \
+    X(DeleteSync) \
+    X(GetIntegerv) \
+    X(GetStringi) \
     X(GenVertexArrays) \
     X(DeleteVertexArrays) \
     X(BindVertexArray) \
     X(VertexAttribPointer) \
+    X(VertexAttribIPointer) \
     X(EnableVertexAttribArray) \
     X(CreateShader) \
     X(ShaderSource) \
@@ -81,6 +102,7 @@ typedef GLenum glGetError_t(void);
     X(DeleteProgram) \
     X(DrawArrays) \
     X(DrawElements) \
+    X(DrawElementsBaseVertex) \
     X(GenTextures) \
     X(TexImage2D) \
     X(DeleteTextures) \
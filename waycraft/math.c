@@ -263,6 +263,23 @@ m4x4_mulv(m4x4 m, v4 v)
 	return result;
 }
 
+/*
+ * NOTE: extracts the planes of the view frustum from a projection matrix
+ * multiplied with a view matrix. The planes are in the order left, right,
+ * bottom, top, near and far. A point p is inside of a plane if
+ * dot(plane.xyz, p) + plane.w is not negative. The planes are not normalized.
+ */
+static void
+m4x4_frustum_planes(m4x4 m, v4 *planes)
+{
+	for (u32 i = 0; i < 3; i++) {
+		for (u32 j = 0; j < 4; j++) {
+			planes[2 * i + 0].e[j] = m.e[j][3] + m.e[j][i];
+			planes[2 * i + 1].e[j] = m.e[j][3] - m.e[j][i];
+		}
+	}
+}
+
 static v3
 m3x3_mulv(m3x3 m, v3 v)
 {
@@ -1,3 +1,8 @@
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NOISE_X86 1
+#endif
+
 static f32
 gradient(u32 hash, f32 x, f32 y, f32 z)
 {
@@ -122,6 +127,352 @@ perlin_noise_layered(v3 point, u32 octave_count, f32 persistance)
 	return result;
 }
 
+/*
+ * NOTE: the batch versions evaluate the layered noise for eight points at
+ * once. The gradient is selected without branches: the first component is
+ * x for hashes below eight and y otherwise, the second component is y for
+ * hashes below four, x for 12 and 14 and z otherwise. The lowest two bits of
+ * the hash negate the components. This matches gradient bit for bit, since
+ * the kernels do the same floating point operations in the same order.
+ */
+typedef void perlin_noise_layered_x8_t(const v3 *points, u32 octave_count,
+    f32 persistance, f32 *result);
+
+static void
+perlin_noise_layered_x8_scalar(const v3 *points, u32 octave_count,
+    f32 persistance, f32 *result)
+{
+	for (u32 i = 0; i < 8; i++) {
+		result[i] = perlin_noise_layered(points[i], octave_count, persistance);
+	}
+}
+
+#if NOISE_X86
+static i32 perlin_noise_hash32[256];
+
+static void
+perlin_noise_hash32_init(void)
+{
+	for (u32 i = 0; i < 256; i++) {
+		perlin_noise_hash32[i] = perlin_noise_hash[i];
+	}
+}
+
+__attribute__((target("avx2")))
+static __m256
+perlin_noise_gradient_avx2(__m256i hash, __m256 x, __m256 y, __m256 z)
+{
+	__m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(0xf));
+	__m256 h_below_8 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(8), h));
+	__m256 h_below_4 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+	__m256 h_is_12_or_14 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+	    _mm256_and_si256(h, _mm256_set1_epi32(13)), _mm256_set1_epi32(12)));
+
+	__m256 a = _mm256_blendv_ps(y, x, h_below_8);
+	__m256 b = _mm256_blendv_ps(_mm256_blendv_ps(z, x, h_is_12_or_14), y, h_below_4);
+	__m256 sign_a = _mm256_castsi256_ps(_mm256_slli_epi32(h, 31));
+	__m256 sign_b = _mm256_castsi256_ps(_mm256_slli_epi32(
+	    _mm256_srli_epi32(h, 1), 31));
+
+	return _mm256_add_ps(_mm256_xor_ps(a, sign_a), _mm256_xor_ps(b, sign_b));
+}
+
+__attribute__((target("avx2")))
+static __m256
+perlin_noise_fade_avx2(__m256 t)
+{
+	__m256 t3 = _mm256_mul_ps(_mm256_mul_ps(t, t), t);
+	__m256 u = _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6)), _mm256_set1_ps(15));
+	u = _mm256_add_ps(_mm256_mul_ps(t, u), _mm256_set1_ps(10));
+	return _mm256_mul_ps(t3, u);
+}
+
+__attribute__((target("avx2")))
+static __m256
+perlin_noise_lerp_avx2(__m256 a, __m256 b, __m256 t)
+{
+	return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+}
+
+__attribute__((target("avx2")))
+static __m256i
+perlin_noise_hash_avx2(__m256i index)
+{
+	index = _mm256_and_si256(index, _mm256_set1_epi32(255));
+	return _mm256_i32gather_epi32(perlin_noise_hash32, index, 4);
+}
+
+__attribute__((target("avx2")))
+static __m256
+perlin_noise_avx2(__m256 x, __m256 y, __m256 z)
+{
+	__m256 floor_x = _mm256_floor_ps(x);
+	__m256 floor_y = _mm256_floor_ps(y);
+	__m256 floor_z = _mm256_floor_ps(z);
+
+	__m256i ix = _mm256_cvttps_epi32(floor_x);
+	__m256i iy = _mm256_cvttps_epi32(floor_y);
+	__m256i iz = _mm256_cvttps_epi32(floor_z);
+	__m256i one = _mm256_set1_epi32(1);
+
+	x = _mm256_sub_ps(x, floor_x);
+	y = _mm256_sub_ps(y, floor_y);
+	z = _mm256_sub_ps(z, floor_z);
+
+	__m256 tx = perlin_noise_fade_avx2(x);
+	__m256 ty = perlin_noise_fade_avx2(y);
+	__m256 tz = perlin_noise_fade_avx2(z);
+
+	__m256i a0 = perlin_noise_hash_avx2(ix);
+	__m256i a1 = perlin_noise_hash_avx2(_mm256_add_epi32(ix, one));
+	__m256i b00 = perlin_noise_hash_avx2(_mm256_add_epi32(a0, iy));
+	__m256i b01 = perlin_noise_hash_avx2(_mm256_add_epi32(_mm256_add_epi32(a0, iy), one));
+	__m256i b10 = perlin_noise_hash_avx2(_mm256_add_epi32(a1, iy));
+	__m256i b11 = perlin_noise_hash_avx2(_mm256_add_epi32(_mm256_add_epi32(a1, iy), one));
+
+	__m256i iz1 = _mm256_add_epi32(iz, one);
+	__m256i h000 = perlin_noise_hash_avx2(_mm256_add_epi32(b00, iz));
+	__m256i h001 = perlin_noise_hash_avx2(_mm256_add_epi32(b10, iz));
+	__m256i h010 = perlin_noise_hash_avx2(_mm256_add_epi32(b01, iz));
+	__m256i h011 = perlin_noise_hash_avx2(_mm256_add_epi32(b11, iz));
+	__m256i h100 = perlin_noise_hash_avx2(_mm256_add_epi32(b00, iz1));
+	__m256i h101 = perlin_noise_hash_avx2(_mm256_add_epi32(b10, iz1));
+	__m256i h110 = perlin_noise_hash_avx2(_mm256_add_epi32(b01, iz1));
+	__m256i h111 = perlin_noise_hash_avx2(_mm256_add_epi32(b11, iz1));
+
+	__m256 x1 = _mm256_sub_ps(x, _mm256_set1_ps(1));
+	__m256 y1 = _mm256_sub_ps(y, _mm256_set1_ps(1));
+	__m256 z1 = _mm256_sub_ps(z, _mm256_set1_ps(1));
+
+	__m256 g000 = perlin_noise_gradient_avx2(h000, x,  y,  z);
+	__m256 g001 = perlin_noise_gradient_avx2(h001, x1, y,  z);
+	__m256 g010 = perlin_noise_gradient_avx2(h010, x,  y1, z);
+	__m256 g011 = perlin_noise_gradient_avx2(h011, x1, y1, z);
+	__m256 g100 = perlin_noise_gradient_avx2(h100, x,  y,  z1);
+	__m256 g101 = perlin_noise_gradient_avx2(h101, x1, y,  z1);
+	__m256 g110 = perlin_noise_gradient_avx2(h110, x,  y1, z1);
+	__m256 g111 = perlin_noise_gradient_avx2(h111, x1, y1, z1);
+
+	__m256 x00 = perlin_noise_lerp_avx2(g000, g001, tx);
+	__m256 x01 = perlin_noise_lerp_avx2(g010, g011, tx);
+	__m256 y0 = perlin_noise_lerp_avx2(x00, x01, ty);
+
+	__m256 x10 = perlin_noise_lerp_avx2(g100, g101, tx);
+	__m256 x11 = perlin_noise_lerp_avx2(g110, g111, tx);
+	__m256 y1_ = perlin_noise_lerp_avx2(x10, x11, ty);
+
+	__m256 result = perlin_noise_lerp_avx2(y0, y1_, tz);
+	result = _mm256_mul_ps(_mm256_set1_ps(0.5f),
+	    _mm256_add_ps(result, _mm256_set1_ps(1.0f)));
+	return result;
+}
+
+__attribute__((target("avx2")))
+static void
+perlin_noise_layered_x8_avx2(const v3 *points, u32 octave_count,
+    f32 persistance, f32 *result)
+{
+	f32 px[8], py[8], pz[8];
+	for (u32 i = 0; i < 8; i++) {
+		px[i] = points[i].x;
+		py[i] = points[i].y;
+		pz[i] = points[i].z;
+	}
+
+	__m256 x = _mm256_loadu_ps(px);
+	__m256 y = _mm256_loadu_ps(py);
+	__m256 z = _mm256_loadu_ps(pz);
+
+	__m256 sum = _mm256_setzero_ps();
+	f32 max_value = 0.0f;
+	f32 amplitude = 1.0f;
+	f32 frequency = 1.0f;
+
+	while (octave_count-- > 0) {
+		__m256 f = _mm256_set1_ps(frequency);
+		__m256 noise = perlin_noise_avx2(_mm256_mul_ps(x, f),
+		    _mm256_mul_ps(y, f), _mm256_mul_ps(z, f));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(amplitude), noise));
+
+		max_value += amplitude;
+		amplitude *= persistance;
+		frequency *= 2.0f;
+	}
+
+	sum = _mm256_div_ps(sum, _mm256_set1_ps(max_value));
+	_mm256_storeu_ps(result, sum);
+}
+
+__attribute__((target("sse4.1")))
+static __m128
+perlin_noise_gradient_sse4(__m128i hash, __m128 x, __m128 y, __m128 z)
+{
+	__m128i h = _mm_and_si128(hash, _mm_set1_epi32(0xf));
+	__m128 h_below_8 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(8)));
+	__m128 h_below_4 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+	__m128 h_is_12_or_14 = _mm_castsi128_ps(_mm_cmpeq_epi32(
+	    _mm_and_si128(h, _mm_set1_epi32(13)), _mm_set1_epi32(12)));
+
+	__m128 a = _mm_blendv_ps(y, x, h_below_8);
+	__m128 b = _mm_blendv_ps(_mm_blendv_ps(z, x, h_is_12_or_14), y, h_below_4);
+	__m128 sign_a = _mm_castsi128_ps(_mm_slli_epi32(h, 31));
+	__m128 sign_b = _mm_castsi128_ps(_mm_slli_epi32(_mm_srli_epi32(h, 1), 31));
+
+	return _mm_add_ps(_mm_xor_ps(a, sign_a), _mm_xor_ps(b, sign_b));
+}
+
+__attribute__((target("sse4.1")))
+static __m128
+perlin_noise_fade_sse4(__m128 t)
+{
+	__m128 t3 = _mm_mul_ps(_mm_mul_ps(t, t), t);
+	__m128 u = _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6)), _mm_set1_ps(15));
+	u = _mm_add_ps(_mm_mul_ps(t, u), _mm_set1_ps(10));
+	return _mm_mul_ps(t3, u);
+}
+
+__attribute__((target("sse4.1")))
+static __m128
+perlin_noise_lerp_sse4(__m128 a, __m128 b, __m128 t)
+{
+	return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+// NOTE: there is no gather instruction before AVX2
+__attribute__((target("sse4.1")))
+static __m128i
+perlin_noise_hash_sse4(__m128i index)
+{
+	u32 i[4];
+	_mm_storeu_si128((__m128i *)i, index);
+
+	u8 *hash = perlin_noise_hash;
+	return _mm_setr_epi32(hash[i[0] & 255], hash[i[1] & 255],
+	    hash[i[2] & 255], hash[i[3] & 255]);
+}
+
+__attribute__((target("sse4.1")))
+static __m128
+perlin_noise_sse4(__m128 x, __m128 y, __m128 z)
+{
+	__m128 floor_x = _mm_floor_ps(x);
+	__m128 floor_y = _mm_floor_ps(y);
+	__m128 floor_z = _mm_floor_ps(z);
+
+	__m128i ix = _mm_cvttps_epi32(floor_x);
+	__m128i iy = _mm_cvttps_epi32(floor_y);
+	__m128i iz = _mm_cvttps_epi32(floor_z);
+	__m128i one = _mm_set1_epi32(1);
+
+	x = _mm_sub_ps(x, floor_x);
+	y = _mm_sub_ps(y, floor_y);
+	z = _mm_sub_ps(z, floor_z);
+
+	__m128 tx = perlin_noise_fade_sse4(x);
+	__m128 ty = perlin_noise_fade_sse4(y);
+	__m128 tz = perlin_noise_fade_sse4(z);
+
+	__m128i a0 = perlin_noise_hash_sse4(ix);
+	__m128i a1 = perlin_noise_hash_sse4(_mm_add_epi32(ix, one));
+	__m128i b00 = perlin_noise_hash_sse4(_mm_add_epi32(a0, iy));
+	__m128i b01 = perlin_noise_hash_sse4(_mm_add_epi32(_mm_add_epi32(a0, iy), one));
+	__m128i b10 = perlin_noise_hash_sse4(_mm_add_epi32(a1, iy));
+	__m128i b11 = perlin_noise_hash_sse4(_mm_add_epi32(_mm_add_epi32(a1, iy), one));
+
+	__m128i iz1 = _mm_add_epi32(iz, one);
+	__m128i h000 = perlin_noise_hash_sse4(_mm_add_epi32(b00, iz));
+	__m128i h001 = perlin_noise_hash_sse4(_mm_add_epi32(b10, iz));
+	__m128i h010 = perlin_noise_hash_sse4(_mm_add_epi32(b01, iz));
+	__m128i h011 = perlin_noise_hash_sse4(_mm_add_epi32(b11, iz));
+	__m128i h100 = perlin_noise_hash_sse4(_mm_add_epi32(b00, iz1));
+	__m128i h101 = perlin_noise_hash_sse4(_mm_add_epi32(b10, iz1));
+	__m128i h110 = perlin_noise_hash_sse4(_mm_add_epi32(b01, iz1));
+	__m128i h111 = perlin_noise_hash_sse4(_mm_add_epi32(b11, iz1));
+
+	__m128 x1 = _mm_sub_ps(x, _mm_set1_ps(1));
+	__m128 y1 = _mm_sub_ps(y, _mm_set1_ps(1));
+	__m128 z1 = _mm_sub_ps(z, _mm_set1_ps(1));
+
+	__m128 g000 = perlin_noise_gradient_sse4(h000, x,  y,  z);
+	__m128 g001 = perlin_noise_gradient_sse4(h001, x1, y,  z);
+	__m128 g010 = perlin_noise_gradient_sse4(h010, x,  y1, z);
+	__m128 g011 = perlin_noise_gradient_sse4(h011, x1, y1, z);
+	__m128 g100 = perlin_noise_gradient_sse4(h100, x,  y,  z1);
+	__m128 g101 = perlin_noise_gradient_sse4(h101, x1, y,  z1);
+	__m128 g110 = perlin_noise_gradient_sse4(h110, x,  y1, z1);
+	__m128 g111 = perlin_noise_gradient_sse4(h111, x1, y1, z1);
+
+	__m128 x00 = perlin_noise_lerp_sse4(g000, g001, tx);
+	__m128 x01 = perlin_noise_lerp_sse4(g010, g011, tx);
+	__m128 y0 = perlin_noise_lerp_sse4(x00, x01, ty);
+
+	__m128 x10 = perlin_noise_lerp_sse4(g100, g101, tx);
+	__m128 x11 = perlin_noise_lerp_sse4(g110, g111, tx);
+	__m128 y1_ = perlin_noise_lerp_sse4(x10, x11, ty);
+
+	__m128 result = perlin_noise_lerp_sse4(y0, y1_, tz);
+	result = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_add_ps(result, _mm_set1_ps(1.0f)));
+	return result;
+}
+
+__attribute__((target("sse4.1")))
+static void
+perlin_noise_layered_x8_sse4(const v3 *points, u32 octave_count,
+    f32 persistance, f32 *result)
+{
+	for (u32 half = 0; half < 2; half++) {
+		const v3 *p = points + 4 * half;
+		__m128 x = _mm_setr_ps(p[0].x, p[1].x, p[2].x, p[3].x);
+		__m128 y = _mm_setr_ps(p[0].y, p[1].y, p[2].y, p[3].y);
+		__m128 z = _mm_setr_ps(p[0].z, p[1].z, p[2].z, p[3].z);
+
+		__m128 sum = _mm_setzero_ps();
+		f32 max_value = 0.0f;
+		f32 amplitude = 1.0f;
+		f32 frequency = 1.0f;
+
+		for (u32 i = 0; i < octave_count; i++) {
+			__m128 f = _mm_set1_ps(frequency);
+			__m128 noise = perlin_noise_sse4(_mm_mul_ps(x, f),
+			    _mm_mul_ps(y, f), _mm_mul_ps(z, f));
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(amplitude), noise));
+
+			max_value += amplitude;
+			amplitude *= persistance;
+			frequency *= 2.0f;
+		}
+
+		sum = _mm_div_ps(sum, _mm_set1_ps(max_value));
+		_mm_storeu_ps(result + 4 * half, sum);
+	}
+}
+#endif
+
+// NOTE: the kernel is selected once based on the instruction sets that are
+// supported by the processor.
+static void
+perlin_noise_layered_x8(const v3 points[8], u32 octave_count,
+    f32 persistance, f32 result[8])
+{
+	static perlin_noise_layered_x8_t *kernel;
+
+	if (!kernel) {
+		perlin_noise_layered_x8_t *selected = perlin_noise_layered_x8_scalar;
+#if NOISE_X86
+		__builtin_cpu_init();
+		perlin_noise_hash32_init();
+		if (__builtin_cpu_supports("avx2")) {
+			selected = perlin_noise_layered_x8_avx2;
+		} else if (__builtin_cpu_supports("sse4.1")) {
+			selected = perlin_noise_layered_x8_sse4;
+		}
+#endif
+		kernel = selected;
+	}
+
+	kernel(points, octave_count, persistance, result);
+}
+
 static u32
 xorshift32(u32 *seed)
 {
@@ -48,9 +48,15 @@ struct game_input {
 			u8 move_right;
 			u8 jump;
 			u8 toggle_inventory;
+			u8 toggle_mesh_mode;
+			u8 decrease_view_distance;
+			u8 increase_view_distance;
+			u8 decrease_load_budget;
+			u8 increase_load_budget;
+			u8 toggle_stats;
 		};
 
-		u8 buttons[8];
+		u8 buttons[16];
 	} controller;
 
 	f32 dt;
@@ -95,15 +101,88 @@ struct platform_event {
 };
 
 struct platform_task_queue;
+struct arena;
 
-typedef void platform_task_callback_t(void *data);
-typedef void platform_add_task_t(struct platform_task_queue *queue,
+/*
+ * NOTE: frame critical tasks are waited for in the same frame, interactive
+ * tasks should be done within a few frames and background tasks can take
+ * any time.
+ */
+enum platform_task_priority {
+	PLATFORM_TASK_FRAME,
+	PLATFORM_TASK_INTERACTIVE,
+	PLATFORM_TASK_BACKGROUND,
+	PLATFORM_TASK_PRIORITY_COUNT
+};
+
+/*
+ * NOTE: the queued count is the number of tasks that are waiting to be
+ * executed. The latency is the time from adding a task until it is
+ * executed. The counts and latencies are totals since the start, all times
+ * are in seconds.
+ */
+struct platform_task_stats {
+	u32 queued_count;
+	u64 executed_count;
+	f64 total_latency;
+	f64 max_latency;
+};
+
+// NOTE: the scratch high water is the most memory that the tasks of a
+// thread used at once, the sizes are in bytes.
+struct platform_scratch_stats {
+	usz size;
+	usz high_water;
+};
+
+typedef void platform_task_callback_t(void *data, struct arena *scratch);
+typedef void platform_range_callback_t(void *data, u32 start, u32 end,
+    struct arena *scratch);
+typedef u32 platform_add_task_t(struct platform_task_queue *queue,
+    enum platform_task_priority priority, platform_task_callback_t *callback,
+    void *data);
+typedef u32 platform_add_child_task_t(struct platform_task_queue *queue,
+    u32 parent, enum platform_task_priority priority,
     platform_task_callback_t *callback, void *data);
+typedef void platform_wait_task_t(struct platform_task_queue *queue, u32 task);
+typedef void platform_parallel_for_t(struct platform_task_queue *queue,
+    enum platform_task_priority priority, platform_range_callback_t *callback,
+    void *data, u32 count, u32 batch_size);
+typedef void platform_complete_all_tasks_t(struct platform_task_queue *queue);
+typedef void platform_set_background_quota_t(struct platform_task_queue *queue,
+    f64 quota);
+typedef void platform_get_task_stats_t(struct platform_task_queue *queue,
+    struct platform_task_stats *stats);
+typedef u32 platform_get_scratch_stats_t(struct platform_task_queue *queue,
+    struct platform_scratch_stats *stats, u32 max_count);
 
+/*
+ * NOTE: tasks are executed on the worker threads in no particular order,
+ * but tasks with a higher priority are executed first. Adding a task returns
+ * its handle. A child task keeps its parent from finishing until the child
+ * is finished, so waiting for the parent also waits for all of its children.
+ * Waiting for a task, parallel for and completing all tasks execute other
+ * tasks on the calling thread while they wait. Parallel for calls the
+ * callback with ranges of at most the batch size. Tasks can only be added
+ * from the main thread or from other tasks. The background quota limits the
+ * time that the workers spend on background tasks in each frame, it is in
+ * seconds and zero means no limit. The statistics contain one entry for
+ * each priority. Every thread has a scratch arena, which is passed to its
+ * tasks. Everything that a task allocates from the scratch arena is freed
+ * once the task returns. The scratch statistics contain one entry for each
+ * thread, their count is returned.
+ */
 struct platform_api {
 	struct platform_task_queue *queue;
 
 	platform_add_task_t *add_task;
+	platform_add_child_task_t *add_child_task;
+	platform_wait_task_t *wait_task;
+	platform_parallel_for_t *parallel_for;
+	platform_complete_all_tasks_t *complete_all_tasks;
+	platform_set_background_quota_t *set_background_quota;
+	platform_get_task_stats_t *get_task_stats;
+	platform_get_scratch_stats_t *get_scratch_stats;
 };
 
 struct platform_memory {
@@ -1,13 +1,16 @@
-#define VERTEX_BUFFER_SIZE MB(1)
-#define INDEX_BUFFER_SIZE MB(2)
 #define MESH_SIZE KB(16)
 #define PUSH_BUFFER_SIZE MB(8)
 
+// NOTE: the indices of meshes are 16 bits, larger meshes are drawn in
+// multiple batches.
+#define MAX_MESH_QUAD_COUNT (65536 / 4)
+
 static char *vert_shader_source =
     "#version 330 core\n"
     "layout (location = 0) in vec3 pos;\n"
     "layout (location = 1) in vec2 in_coords;\n"
     "out vec2 coords;\n"
+    "flat out vec2 tile;\n"
     "out vec3 frag_pos;\n"
     "uniform mat4 model;\n"
     "uniform mat4 view;\n"
@@ -16,22 +19,66 @@ static char *vert_shader_source =
     "    gl_Position = projection * view * model * vec4(pos, 1.);\n"
     "    frag_pos = pos;\n"
     "    coords = in_coords;\n"
+    "    tile = vec2(0.);\n"
     "}\n";
 
+/*
+ * NOTE: unpacks the vertices of a mesh, see struct mesh_vertex. The texture
+ * coordinates are the position along the axes of the face, measured in
+ * tiles. The offset is the origin of the mesh relative to the camera, so the
+ * positions stay precise far away from the origin of the world.
+ */
+static char *mesh_vert_shader_source =
+    "#version 330 core\n"
+    "layout (location = 0) in uint vertex;\n"
+    "out vec2 coords;\n"
+    "flat out vec2 tile;\n"
+    "out vec3 frag_pos;\n"
+    "uniform vec3 offset;\n"
+    "uniform mat4 view;\n"
+    "uniform mat4 projection;\n"
+    "const vec3 axis_u[6] = vec3[6](vec3(0, 0, 1), vec3(0, 0, -1),\n"
+    "    vec3(-1, 0, 0), vec3(1, 0, 0), vec3(-1, 0, 0), vec3(1, 0, 0));\n"
+    "const vec3 axis_v[6] = vec3[6](vec3(0, -1, 0), vec3(0, -1, 0),\n"
+    "    vec3(0, 0, 1), vec3(0, 0, 1), vec3(0, -1, 0), vec3(0, -1, 0));\n"
+    "void main() {\n"
+    "    vec3 pos = vec3(uvec3(vertex, vertex >> 5u, vertex >> 10u) & 31u);\n"
+    "    uint face = (vertex >> 15u) & 7u;\n"
+    "    uint atlas_tile = vertex >> 19u;\n"
+    "    coords = vec2(dot(pos, axis_u[face]), dot(pos, axis_v[face]));\n"
+    "    tile = vec2(atlas_tile & 15u, atlas_tile >> 4u);\n"
+    "    pos.y -= 0.1 * float((vertex >> 18u) & 1u);\n"
+    "    frag_pos = offset + pos;\n"
+    "    gl_Position = projection * mat4(mat3(view)) * vec4(frag_pos, 1.);\n"
+    "}\n";
+
+/*
+ * NOTE: with tiling enabled, the texture coordinates are measured in tiles of
+ * a 16x16 atlas. The shader repeats the tile, which allows merged faces of a
+ * mesh to span multiple blocks.
+ */
 static char *frag_shader_source =
     "#version 330 core\n"
     "in vec2 coords;\n"
+    "flat in vec2 tile;\n"
     "in vec3 frag_pos;\n"
     "out vec4 frag_color;\n"
     "uniform int enable_fog;\n"
+    "uniform int enable_tiling;\n"
     "uniform sampler2D tex;\n"
     "uniform vec3 camera_pos;\n"
     "void main() {\n"
-    "	frag_color = texture(tex, coords);\n"
+    "	vec2 uv = coords;\n"
+    "	if (enable_tiling != 0) {\n"
+    "		uv = (tile + fract(coords)) / 16.;\n"
+    "	}\n"
+    ""
+    "	frag_color = texture(tex, uv);\n"
     ""
     "	if (enable_fog != 0) {\n"
     "		float dist = distance(camera_pos, frag_pos);\n"
-    "		float alpha = clamp(0.1 * (256 - dist), 0, 1);\n"
+    "		float alpha = clamp((" STRINGIFY(FOG_DISTANCE) ". - dist) / "
+    STRINGIFY(FOG_WIDTH) "., 0., 1.);\n"
     "		frag_color = mix(vec4(0.45, 0.65, 0.85, 1.0), frag_color, alpha);\n"
     "	}\n"
     "}\n";
@@ -42,6 +89,12 @@ static const u32 render_cmd_size[RENDER_COMMAND_COUNT] = {
 	[RENDER_MESH]  = sizeof(struct render_cmd_mesh),
 };
 
+static const u32 render_cmd_pass[RENDER_COMMAND_COUNT] = {
+	[RENDER_CLEAR] = RENDER_PASS_CLEAR,
+	[RENDER_QUADS] = RENDER_PASS_DRAW,
+	[RENDER_MESH]  = RENDER_PASS_DRAW,
+};
+
 static void
 gl_uniform_m4x4(u32 uniform, m4x4 value)
 {
@@ -107,6 +160,88 @@ gl_program_error(u32 program, char *buffer, u32 size)
 	gl.GetProgramInfoLog(program, size - 1, 0, buffer);
 }
 
+static bool
+gl_has_extension(const char *name)
+{
+	i32 extension_count = 0;
+	gl.GetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+	for (i32 i = 0; i < extension_count; i++) {
+		const char *extension = (const char *)gl.GetStringi(GL_EXTENSIONS, i);
+		if (extension && strcmp(extension, name) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * NOTE: maps the whole stream buffers if they are persistent, otherwise only
+ * the region of the current frame is mapped. The stream buffers have to be
+ * bound.
+ */
+static void
+renderer_map_stream(struct renderer *renderer, u32 flags)
+{
+	struct render_stream *stream = &renderer->stream;
+	usize vertex_size = RENDER_STREAM_VERTEX_COUNT * sizeof(struct vertex);
+	usize index_size = RENDER_STREAM_INDEX_COUNT * sizeof(u32);
+	usize vertex_offset = 0;
+	usize index_offset = 0;
+	if (stream->is_persistent) {
+		vertex_size *= RENDER_STREAM_FRAME_COUNT;
+		index_size *= RENDER_STREAM_FRAME_COUNT;
+	} else {
+		vertex_offset = stream->frame * vertex_size;
+		index_offset = stream->frame * index_size;
+	}
+
+	stream->mapped_vertices = gl.MapBufferRange(GL_ARRAY_BUFFER,
+	    vertex_offset, vertex_size, flags);
+	stream->mapped_indices = gl.MapBufferRange(GL_ELEMENT_ARRAY_BUFFER,
+	    index_offset, index_size, flags);
+	assert(stream->mapped_vertices && stream->mapped_indices);
+	stream->is_mapped = true;
+}
+
+static void
+renderer_unmap_stream(struct renderer *renderer)
+{
+	struct render_stream *stream = &renderer->stream;
+	if (stream->is_mapped && !stream->is_persistent) {
+		gl.BindVertexArray(renderer->vertex_array);
+		gl.BindBuffer(GL_ARRAY_BUFFER, renderer->vertex_buffer);
+		gl.UnmapBuffer(GL_ARRAY_BUFFER);
+		gl.UnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+		stream->is_mapped = false;
+	}
+}
+
+// NOTE: the stream buffers have to be bound
+static void
+renderer_init_stream(struct renderer *renderer)
+{
+	struct render_stream *stream = &renderer->stream;
+	usize vertex_buffer_size = RENDER_STREAM_FRAME_COUNT *
+	    RENDER_STREAM_VERTEX_COUNT * sizeof(struct vertex);
+	usize index_buffer_size = RENDER_STREAM_FRAME_COUNT *
+	    RENDER_STREAM_INDEX_COUNT * sizeof(u32);
+
+	stream->is_persistent = gl_has_extension("GL_ARB_buffer_storage");
+	if (stream->is_persistent) {
+		u32 flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		gl.BufferStorage(GL_ARRAY_BUFFER, vertex_buffer_size, 0, flags);
+		gl.BufferStorage(GL_ELEMENT_ARRAY_BUFFER, index_buffer_size, 0, flags);
+		renderer_map_stream(renderer, flags);
+	} else {
+		gl.BufferData(GL_ARRAY_BUFFER, vertex_buffer_size, 0, GL_STREAM_DRAW);
+		gl.BufferData(GL_ELEMENT_ARRAY_BUFFER, index_buffer_size, 0, GL_STREAM_DRAW);
+	}
+
+	// NOTE: the first frame starts with the first region
+	stream->frame = RENDER_STREAM_FRAME_COUNT - 1;
+}
+
 static struct renderer
 renderer_init(struct arena *arena)
 {
@@ -134,6 +269,24 @@ renderer_init(struct arena *arena)
 	renderer.shader.enable_fog = gl.GetUniformLocation(program, "enable_fog");
 	renderer.shader.program = program;
 
+	program = gl_program_create(mesh_vert_shader_source, frag_shader_source);
+	if (program == 0) {
+		char error[1024] = {0};
+		gl_program_error(program, error, sizeof(error));
+		fprintf(stderr, "Failed to create mesh program: %s\n", error);
+		assert(!"Failed to create mesh program");
+	}
+
+	renderer.mesh_shader.offset = gl.GetUniformLocation(program, "offset");
+	renderer.mesh_shader.view = gl.GetUniformLocation(program, "view");
+	renderer.mesh_shader.projection = gl.GetUniformLocation(program, "projection");
+	renderer.mesh_shader.enable_fog = gl.GetUniformLocation(program, "enable_fog");
+	renderer.mesh_shader.program = program;
+
+	gl.UseProgram(program);
+	gl.Uniform1i(gl.GetUniformLocation(program, "enable_tiling"), true);
+	gl.UseProgram(0);
+
 	// NOTE: initialize the main vertex array
 	gl.GenVertexArrays(1, &renderer.vertex_array);
 	gl.GenBuffers(1, &renderer.vertex_buffer);
@@ -142,6 +295,7 @@ renderer_init(struct arena *arena)
 	gl.BindVertexArray(renderer.vertex_array);
 	gl.BindBuffer(GL_ARRAY_BUFFER, renderer.vertex_buffer);
 	gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer.index_buffer);
+	renderer_init_stream(&renderer);
 
 	gl.VertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
 	    (const void *)offsetof(struct vertex, position));
@@ -152,13 +306,56 @@ renderer_init(struct arena *arena)
 
 	gl.BindVertexArray(0);
 
+	// NOTE: the quad indices are shared by all meshes
+	u32 quad_index_count = MAX_MESH_QUAD_COUNT * 6;
+	u16 *quad_indices = ALLOC(arena, quad_index_count, u16);
+	for (u32 i = 0; i < MAX_MESH_QUAD_COUNT; i++) {
+		quad_indices[6 * i + 0] = 4 * i;
+		quad_indices[6 * i + 1] = 4 * i + 2;
+		quad_indices[6 * i + 2] = 4 * i + 1;
+		quad_indices[6 * i + 3] = 4 * i + 2;
+		quad_indices[6 * i + 4] = 4 * i + 3;
+		quad_indices[6 * i + 5] = 4 * i + 1;
+	}
+
+	gl.GenBuffers(1, &renderer.quad_index_buffer);
+	gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer.quad_index_buffer);
+	gl.BufferData(GL_ELEMENT_ARRAY_BUFFER, quad_index_count * sizeof(u16),
+	    quad_indices, GL_STATIC_DRAW);
+	gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
 	// NOTE: allocate memory for the meshes
-	u32 max_mesh_count = 32 * 32 * 32;
+	u32 max_mesh_count = MAX_MESH_COUNT;
 	renderer.meshes = ALLOC(arena, max_mesh_count, struct mesh);
 	renderer.max_mesh_count = max_mesh_count;
+	renderer.mesh_memory_budget = DEFAULT_MESH_MEMORY_BUDGET;
 	// NOTE: we ignore the first mesh
 	renderer.mesh_count = 1;
 
+	// NOTE: every free range is followed by a mesh or the end of the buffer
+	struct mesh_allocator *allocator = &renderer.mesh_allocator;
+	allocator->max_free_range_count = max_mesh_count + 1;
+	allocator->free_ranges = ALLOC(arena, allocator->max_free_range_count,
+	    struct mesh_range);
+	allocator->max_vertex_count = DEFAULT_MESH_VERTEX_BUFFER_SIZE /
+	    sizeof(struct mesh_vertex);
+	allocator->free_ranges[0].offset = 0;
+	allocator->free_ranges[0].size = allocator->max_vertex_count;
+	allocator->free_range_count = 1;
+
+	gl.GenBuffers(1, &renderer.mesh_vertex_buffer);
+	gl.BindBuffer(GL_ARRAY_BUFFER, renderer.mesh_vertex_buffer);
+	gl.BufferData(GL_ARRAY_BUFFER, DEFAULT_MESH_VERTEX_BUFFER_SIZE, 0,
+	    GL_STATIC_DRAW);
+
+	gl.GenVertexArrays(1, &renderer.mesh_vertex_array);
+	gl.BindVertexArray(renderer.mesh_vertex_array);
+	gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer.quad_index_buffer);
+	gl.VertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(struct mesh_vertex),
+	    (const void *)offsetof(struct mesh_vertex, packed));
+	gl.EnableVertexAttribArray(0);
+	gl.BindVertexArray(0);
+
 	// NOTE: generate a white texture
 	u8 white[4] = { 0xff, 0xff, 0xff, 0xff };
 	gl.GenTextures(1, &renderer.white_texture);
@@ -174,90 +371,528 @@ renderer_init(struct arena *arena)
 static void
 renderer_finish(struct renderer *renderer)
 {
-	u32 mesh_count = renderer->mesh_count;
-	struct mesh *mesh = renderer->meshes;
-	while (mesh_count-- > 0) {
-		gl.DeleteVertexArrays(1, &mesh->vertex_array);
-		gl.DeleteBuffers(1, &mesh->vertex_buffer);
-		gl.DeleteBuffers(1, &mesh->index_buffer);
-
-		mesh++;
+	struct render_stream *stream = &renderer->stream;
+	for (u32 i = 0; i < RENDER_STREAM_FRAME_COUNT; i++) {
+		if (stream->fences[i]) {
+			gl.DeleteSync(stream->fences[i]);
+		}
 	}
 
+	gl.DeleteVertexArrays(1, &renderer->vertex_array);
+	gl.DeleteBuffers(1, &renderer->vertex_buffer);
+	gl.DeleteBuffers(1, &renderer->index_buffer);
+
+	gl.DeleteVertexArrays(1, &renderer->mesh_vertex_array);
+	gl.DeleteBuffers(1, &renderer->mesh_vertex_buffer);
+	gl.DeleteBuffers(1, &renderer->quad_index_buffer);
+	gl.DeleteProgram(renderer->mesh_shader.program);
+
 	gl.DeleteProgram(renderer->shader.program);
 }
 
+// NOTE: the vertices and indices are taken from the stream of the frame
 static struct render_cmdbuf
-render_cmdbuf_init(struct arena *arena, u32 max_push_buffer_size,
-    u32 max_vertex_count, u32 max_index_count)
+render_cmdbuf_init(struct renderer *renderer, struct arena *arena,
+    u32 max_push_buffer_size, u32 max_vertex_count, u32 max_index_count)
 {
+	struct render_stream *stream = &renderer->stream;
+	assert(stream->is_mapped);
+	assert(stream->vertex_count + max_vertex_count <= RENDER_STREAM_VERTEX_COUNT);
+	assert(stream->index_count + max_index_count <= RENDER_STREAM_INDEX_COUNT);
+
 	struct render_cmdbuf cmdbuf = {0};
 	cmdbuf.max_vertex_count     = max_vertex_count;
 	cmdbuf.max_index_count      = max_index_count;
 	cmdbuf.max_push_buffer_size = max_push_buffer_size;
 
+	// NOTE: the quads command is the smallest command
+	u32 min_command_size = sizeof(struct render_cmd) + sizeof(struct render_cmd_quads);
+	assert(max_push_buffer_size <= RENDER_KEY_OFFSET_MASK);
+	cmdbuf.max_command_count = max_push_buffer_size / min_command_size;
+
+	cmdbuf.sort_keys     = ALLOC(arena, cmdbuf.max_command_count, u64);
+	cmdbuf.sort_buffer   = ALLOC(arena, cmdbuf.max_command_count, u64);
 	cmdbuf.push_buffer   = ALLOC(arena, max_push_buffer_size, u8);
-	cmdbuf.vertex_buffer = ALLOC(arena, max_vertex_count, struct vertex);
-	cmdbuf.index_buffer  = ALLOC(arena, max_index_count, u32);
+	cmdbuf.vertex_buffer = stream->vertices + stream->vertex_count;
+	cmdbuf.index_buffer  = stream->indices + stream->index_count;
+	cmdbuf.base_vertex   = stream->frame * RENDER_STREAM_VERTEX_COUNT +
+	    stream->vertex_count;
+	cmdbuf.base_index    = stream->frame * RENDER_STREAM_INDEX_COUNT +
+	    stream->index_count;
+
+	stream->vertex_count += max_vertex_count;
+	stream->index_count += max_index_count;
 	return cmdbuf;
 }
 
+static struct mesh_buffer
+mesh_buffer_init(struct arena *arena, u32 max_vertex_count)
+{
+	struct mesh_buffer buffer = {0};
+	buffer.vertices = ALLOC(arena, max_vertex_count, struct mesh_vertex);
+	buffer.max_vertex_count = max_vertex_count;
+	return buffer;
+}
+
+static inline struct mesh_vertex
+mesh_vertex(u32 x, u32 y, u32 z, u32 face, u32 is_lowered, u32 tile)
+{
+	assert(x < 32 && y < 32 && z < 32);
+	assert(face < 8 && is_lowered < 2 && tile < 256);
+
+	struct mesh_vertex result;
+	result.packed = x | y << 5 | z << 10 | face << 15 | is_lowered << 18 |
+	    tile << 19;
+	return result;
+}
+
+// NOTE: the vertices are in the same order as in render_quad
+static inline void
+mesh_push_quad(struct mesh_buffer *buffer, struct mesh_vertex vertex0,
+    struct mesh_vertex vertex1, struct mesh_vertex vertex2,
+    struct mesh_vertex vertex3)
+{
+	assert(buffer->vertex_count + 4 <= buffer->max_vertex_count);
+
+	struct mesh_vertex *out_vertex = buffer->vertices + buffer->vertex_count;
+	out_vertex[0] = vertex0;
+	out_vertex[1] = vertex1;
+	out_vertex[2] = vertex2;
+	out_vertex[3] = vertex3;
+	buffer->vertex_count += 4;
+}
+
+// NOTE: returns the index of the first free range after the offset
+static u32
+mesh_allocator_search(const struct mesh_allocator *allocator, u32 offset)
+{
+	u32 low = 0;
+	u32 high = allocator->free_range_count;
+	while (low < high) {
+		u32 mid = (low + high) / 2;
+		if (allocator->free_ranges[mid].offset < offset) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
 static void
-renderer_build_command_buffer(struct renderer *renderer,
-    struct render_cmdbuf *cmd_buffer, u32 *cmd_buffer_id)
+mesh_allocator_free(struct mesh_allocator *allocator, u32 offset, u32 size)
+{
+	if (size == 0) {
+		return;
+	}
+
+	struct mesh_range *ranges = allocator->free_ranges;
+	u32 i = mesh_allocator_search(allocator, offset);
+	bool merge_prev = i > 0 && ranges[i - 1].offset + ranges[i - 1].size == offset;
+	bool merge_next = i < allocator->free_range_count &&
+	    offset + size == ranges[i].offset;
+
+	if (merge_prev && merge_next) {
+		ranges[i - 1].size += size + ranges[i].size;
+		memmove(ranges + i, ranges + i + 1,
+		    (allocator->free_range_count - i - 1) * sizeof(*ranges));
+		allocator->free_range_count--;
+	} else if (merge_prev) {
+		ranges[i - 1].size += size;
+	} else if (merge_next) {
+		ranges[i].offset = offset;
+		ranges[i].size += size;
+	} else {
+		assert(allocator->free_range_count < allocator->max_free_range_count);
+		memmove(ranges + i + 1, ranges + i,
+		    (allocator->free_range_count - i) * sizeof(*ranges));
+		ranges[i].offset = offset;
+		ranges[i].size = size;
+		allocator->free_range_count++;
+	}
+
+	assert(allocator->used_vertex_count >= size);
+	allocator->used_vertex_count -= size;
+}
+
+// NOTE: returns false if no free range is large enough
+static bool
+mesh_allocator_alloc(struct mesh_allocator *allocator, u32 size, u32 *offset)
 {
-	assert(renderer->mesh_count < renderer->max_mesh_count);
+	struct mesh_range *ranges = allocator->free_ranges;
+	u32 best = allocator->free_range_count;
+	for (u32 i = 0; i < allocator->free_range_count; i++) {
+		if (ranges[i].size >= size &&
+		    (best == allocator->free_range_count || ranges[i].size < ranges[best].size)) {
+			best = i;
+			if (ranges[i].size == size) {
+				break;
+			}
+		}
+	}
 
-	u32 vertex_array, vertex_buffer, index_buffer;
-	u32 index_count = cmd_buffer->index_count;
+	if (best == allocator->free_range_count) {
+		return false;
+	}
 
-	gl.GenVertexArrays(1, &vertex_array);
-	gl.GenBuffers(1, &vertex_buffer);
-	gl.GenBuffers(1, &index_buffer);
+	*offset = ranges[best].offset;
+	ranges[best].offset += size;
+	ranges[best].size -= size;
+	if (ranges[best].size == 0) {
+		memmove(ranges + best, ranges + best + 1,
+		    (allocator->free_range_count - best - 1) * sizeof(*ranges));
+		allocator->free_range_count--;
+	}
 
-	gl.BindVertexArray(vertex_array);
-	gl.BindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-	gl.BufferData(GL_ARRAY_BUFFER, cmd_buffer->vertex_count * sizeof(struct vertex),
-	    cmd_buffer->vertex_buffer, GL_STATIC_DRAW);
-	gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
-	gl.BufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(u32),
-	    cmd_buffer->index_buffer, GL_STATIC_DRAW);
+	allocator->used_vertex_count += size;
+	return true;
+}
 
-	gl.VertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
-	    (const void *)offsetof(struct vertex, position));
-	gl.EnableVertexAttribArray(0);
-	gl.VertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
-	    (const void *)offsetof(struct vertex, texcoord));
-	gl.EnableVertexAttribArray(1);
+/*
+ * NOTE: grows the vertex buffer of the meshes until it has room for at least
+ * the given number of vertices at its end. The vertices are copied into the
+ * new buffer, so the offsets of the meshes don't change.
+ */
+static void
+renderer_grow_mesh_buffer(struct renderer *renderer, u32 size)
+{
+	struct mesh_allocator *allocator = &renderer->mesh_allocator;
+	u32 old_vertex_count = allocator->max_vertex_count;
+	u32 new_vertex_count = old_vertex_count;
+	while (new_vertex_count - old_vertex_count < size) {
+		assert(new_vertex_count <= UINT32_MAX / 2);
+		new_vertex_count *= 2;
+	}
 
+	u32 vertex_buffer;
+	gl.GenBuffers(1, &vertex_buffer);
+	gl.BindBuffer(GL_COPY_WRITE_BUFFER, vertex_buffer);
+	gl.BufferData(GL_COPY_WRITE_BUFFER,
+	    new_vertex_count * sizeof(struct mesh_vertex), 0, GL_STATIC_DRAW);
+	gl.BindBuffer(GL_COPY_READ_BUFFER, renderer->mesh_vertex_buffer);
+	gl.CopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+	    old_vertex_count * sizeof(struct mesh_vertex));
+	gl.DeleteBuffers(1, &renderer->mesh_vertex_buffer);
+	renderer->mesh_vertex_buffer = vertex_buffer;
+
+	gl.BindVertexArray(renderer->mesh_vertex_array);
+	gl.BindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	gl.VertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(struct mesh_vertex),
+	    (const void *)offsetof(struct mesh_vertex, packed));
 	gl.BindVertexArray(0);
 
-	if (*cmd_buffer_id == 0) {
-		*cmd_buffer_id = renderer->mesh_count++;
+	// NOTE: the new memory is marked as used, so that freeing it merges it
+	// with the last free range.
+	allocator->max_vertex_count = new_vertex_count;
+	allocator->used_vertex_count += new_vertex_count - old_vertex_count;
+	mesh_allocator_free(allocator, old_vertex_count,
+	    new_vertex_count - old_vertex_count);
+}
+
+// NOTE: returns null if the handle is no longer valid
+static struct mesh *
+renderer_get_mesh(struct renderer *renderer, u32 handle)
+{
+	u32 index = handle & (MAX_MESH_COUNT - 1);
+	u32 generation = handle >> MESH_INDEX_BITS;
+
+	struct mesh *result = 0;
+	if (index != 0 && index < renderer->mesh_count) {
+		struct mesh *mesh = &renderer->meshes[index];
+		if (mesh->is_used && mesh->generation == generation) {
+			result = mesh;
+		}
+	}
+
+	return result;
+}
+
+// NOTE: returns zero if there are no free meshes
+static u32
+renderer_alloc_mesh(struct renderer *renderer)
+{
+	u32 index = 0;
+	if (renderer->first_free_mesh != 0) {
+		index = renderer->first_free_mesh;
+		renderer->first_free_mesh = renderer->meshes[index].next_free;
+	} else if (renderer->mesh_count < renderer->max_mesh_count) {
+		index = renderer->mesh_count++;
+	} else {
+		return 0;
+	}
+
+	struct mesh *mesh = &renderer->meshes[index];
+	mesh->vertex_offset = 0;
+	mesh->vertex_capacity = 0;
+	mesh->index_count = 0;
+	mesh->next_free = 0;
+	mesh->is_used = true;
+	renderer->used_mesh_count++;
+
+	return mesh->generation << MESH_INDEX_BITS | index;
+}
+
+// NOTE: freeing an invalid handle does nothing
+static void
+renderer_free_mesh(struct renderer *renderer, u32 handle)
+{
+	struct mesh *mesh = renderer_get_mesh(renderer, handle);
+	if (mesh) {
+		mesh_allocator_free(&renderer->mesh_allocator, mesh->vertex_offset,
+		    mesh->vertex_capacity);
+
+		u32 index = mesh - renderer->meshes;
+		mesh->vertex_capacity = 0;
+		mesh->index_count = 0;
+		mesh->generation = (mesh->generation + 1) & MESH_GENERATION_MASK;
+		mesh->is_used = false;
+		mesh->next_free = renderer->first_free_mesh;
+		renderer->first_free_mesh = index;
+		renderer->used_mesh_count--;
+	}
+}
+
+// NOTE: returns the number of bytes that the vertices of a mesh use
+static usize
+renderer_get_mesh_size(struct renderer *renderer, u32 handle)
+{
+	struct mesh *mesh = renderer_get_mesh(renderer, handle);
+	usize result = 0;
+	if (mesh) {
+		result = (usize)mesh->vertex_capacity * sizeof(struct mesh_vertex);
+	}
+
+	return result;
+}
+
+static usize
+renderer_get_mesh_memory(const struct renderer *renderer)
+{
+	usize result = (usize)renderer->mesh_allocator.used_vertex_count *
+	    sizeof(struct mesh_vertex);
+	return result;
+}
+
+/*
+ * NOTE: uploads the vertices of a mesh into the vertex buffer of the meshes.
+ * A new mesh is allocated if the handle is not valid. The mesh keeps its
+ * range if the vertices still fit, otherwise the range is freed and the mesh
+ * is moved into a new one. Returns false if there are no free meshes.
+ */
+static bool
+renderer_build_mesh(struct renderer *renderer, const struct mesh_buffer *buffer,
+    u32 *handle)
+{
+	struct mesh *mesh = renderer_get_mesh(renderer, *handle);
+	if (!mesh) {
+		*handle = renderer_alloc_mesh(renderer);
+		mesh = renderer_get_mesh(renderer, *handle);
+		if (!mesh) {
+			return false;
+		}
+	}
+
+	struct mesh_allocator *allocator = &renderer->mesh_allocator;
+	u32 granularity = MESH_VERTEX_GRANULARITY;
+	u32 capacity = (buffer->vertex_count + granularity - 1) / granularity * granularity;
+	if (capacity <= mesh->vertex_capacity) {
+		mesh_allocator_free(allocator, mesh->vertex_offset + capacity,
+		    mesh->vertex_capacity - capacity);
+	} else {
+		mesh_allocator_free(allocator, mesh->vertex_offset, mesh->vertex_capacity);
+		if (!mesh_allocator_alloc(allocator, capacity, &mesh->vertex_offset)) {
+			renderer_grow_mesh_buffer(renderer, capacity);
+			bool allocated = mesh_allocator_alloc(allocator, capacity,
+			    &mesh->vertex_offset);
+			assert(allocated);
+		}
+	}
+
+	if (capacity == 0) {
+		mesh->vertex_offset = 0;
+	}
+
+	mesh->vertex_capacity = capacity;
+	mesh->index_count = buffer->vertex_count / 4 * 6;
+
+	if (buffer->vertex_count > 0) {
+		gl.BindBuffer(GL_ARRAY_BUFFER, renderer->mesh_vertex_buffer);
+		gl.BufferSubData(GL_ARRAY_BUFFER,
+		    mesh->vertex_offset * sizeof(struct mesh_vertex),
+		    buffer->vertex_count * sizeof(struct mesh_vertex), buffer->vertices);
+	}
+
+	return true;
+}
+
+static struct mesh_stats
+renderer_get_mesh_stats(const struct renderer *renderer)
+{
+	const struct mesh_allocator *allocator = &renderer->mesh_allocator;
+	struct mesh_stats stats = {0};
+
+	u32 vertex_size = sizeof(struct mesh_vertex);
+	stats.size = (usize)allocator->max_vertex_count * vertex_size;
+	stats.used = (usize)allocator->used_vertex_count * vertex_size;
+	stats.free = stats.size - stats.used;
+	stats.free_range_count = allocator->free_range_count;
+	stats.mesh_count = renderer->used_mesh_count;
+
+	for (u32 i = 0; i < allocator->free_range_count; i++) {
+		usize range_size = (usize)allocator->free_ranges[i].size * vertex_size;
+		stats.largest_free_range = MAX(stats.largest_free_range, range_size);
+	}
+
+	if (stats.free > 0) {
+		stats.fragmentation = 1.0f - (f32)stats.largest_free_range / stats.free;
 	}
 
-	struct mesh *mesh = &renderer->meshes[*cmd_buffer_id];
-	mesh->vertex_array = vertex_array;
-	mesh->vertex_buffer = vertex_buffer;
-	mesh->index_buffer = index_buffer;
-	mesh->index_count = index_count;
+	return stats;
+}
+
+/*
+ * NOTE: the fence of the previous frame is inserted at the start of the next
+ * frame, after all of its draw calls. Waiting for the fence of the oldest
+ * region only blocks if the GPU is more than two frames behind.
+ */
+static void
+renderer_begin_frame(struct renderer *renderer)
+{
+	struct render_stream *stream = &renderer->stream;
+	memset(&renderer->stats, 0, sizeof(renderer->stats));
+	renderer_unmap_stream(renderer);
+
+	assert(!stream->fences[stream->frame]);
+	stream->fences[stream->frame] = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	stream->frame = (stream->frame + 1) % RENDER_STREAM_FRAME_COUNT;
+	stream->vertex_count = 0;
+	stream->index_count = 0;
+
+	GLsync fence = stream->fences[stream->frame];
+	if (fence) {
+		u64 timeout = 1000 * 1000 * 1000;
+		while (gl.ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout) ==
+		    GL_TIMEOUT_EXPIRED);
+		gl.DeleteSync(fence);
+		stream->fences[stream->frame] = 0;
+	}
+
+	if (stream->is_persistent) {
+		stream->vertices = stream->mapped_vertices +
+		    stream->frame * RENDER_STREAM_VERTEX_COUNT;
+		stream->indices = stream->mapped_indices +
+		    stream->frame * RENDER_STREAM_INDEX_COUNT;
+	} else {
+		gl.BindVertexArray(renderer->vertex_array);
+		gl.BindBuffer(GL_ARRAY_BUFFER, renderer->vertex_buffer);
+		renderer_map_stream(renderer, GL_MAP_WRITE_BIT |
+		    GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		stream->vertices = stream->mapped_vertices;
+		stream->indices = stream->mapped_indices;
+	}
+}
+
+static void
+renderer_use_program(struct renderer *renderer, u32 program)
+{
+	if (renderer->bound.program != program) {
+		renderer->bound.program = program;
+		renderer->stats.state_change_count++;
+		gl.UseProgram(program);
+	} else {
+		renderer->stats.skipped_state_change_count++;
+	}
+}
+
+static void
+renderer_bind_vertex_array(struct renderer *renderer, u32 vertex_array)
+{
+	if (renderer->bound.vertex_array != vertex_array) {
+		renderer->bound.vertex_array = vertex_array;
+		renderer->stats.state_change_count++;
+		gl.BindVertexArray(vertex_array);
+	} else {
+		renderer->stats.skipped_state_change_count++;
+	}
 }
 
 static void
 renderer_bind_texture(struct renderer *renderer, u32 texture_id)
 {
-	if (texture_id != 0) {
+	if (texture_id == 0) {
+		texture_id = renderer->white_texture;
+	}
+
+	if (renderer->bound.texture != texture_id) {
+		renderer->bound.texture = texture_id;
+		renderer->stats.state_change_count++;
 		gl.BindTexture(GL_TEXTURE_2D, texture_id);
 	} else {
-		gl.BindTexture(GL_TEXTURE_2D, renderer->white_texture);
+		renderer->stats.skipped_state_change_count++;
+	}
+}
+
+/*
+ * NOTE: sorts the keys with a radix sort over their bytes. Bytes that are the
+ * same in every key are skipped, which are most of them. The sorted keys end
+ * up in either the keys or the buffer, the result points to them.
+ */
+static u64 *
+render_sort_keys(u64 *keys, u64 *buffer, u32 count)
+{
+	u64 same_bits = ~(u64)0;
+	for (u32 i = 1; i < count; i++) {
+		same_bits &= ~(keys[i] ^ keys[0]);
 	}
+
+	for (u32 shift = 0; shift < 64; shift += 8) {
+		if (((same_bits >> shift) & 0xff) == 0xff) {
+			continue;
+		}
+
+		u32 offsets[256] = {0};
+		for (u32 i = 0; i < count; i++) {
+			offsets[(keys[i] >> shift) & 0xff]++;
+		}
+
+		u32 total = 0;
+		for (u32 i = 0; i < 256; i++) {
+			u32 digit_count = offsets[i];
+			offsets[i] = total;
+			total += digit_count;
+		}
+
+		for (u32 i = 0; i < count; i++) {
+			buffer[offsets[(keys[i] >> shift) & 0xff]++] = keys[i];
+		}
+
+		u64 *tmp = keys;
+		keys = buffer;
+		buffer = tmp;
+	}
+
+	return keys;
 }
 
+/*
+ * NOTE: the bound state is unknown at the start of a submit, since textures
+ * and buffers are also bound outside of the renderer.
+ */
 static void
 renderer_submit(struct renderer *renderer, struct render_cmdbuf *cmd_buffer)
 {
 	u32 command_count = cmd_buffer->command_count;
 	u8 *push_buffer = cmd_buffer->push_buffer;
+	u64 *keys = render_sort_keys(cmd_buffer->sort_keys,
+	    cmd_buffer->sort_buffer, command_count);
+
+	memset(&renderer->bound, 0, sizeof(renderer->bound));
+	renderer->stats.command_count += command_count;
+
+	// NOTE: the vertices and indices were already written to the stream,
+	// it only has to be unmapped before drawing from it.
+	renderer_unmap_stream(renderer);
 
 	m4x4 model = m4x4_id(1);
 	m4x4 view = cmd_buffer->transform.view;
@@ -268,79 +903,81 @@ renderer_submit(struct renderer *renderer, struct render_cmdbuf *cmd_buffer)
 	assert(viewport.width != 0);
 	assert(viewport.height != 0);
 	gl.Viewport(0, 0, viewport.width, viewport.height);
-	gl.UseProgram(renderer->shader.program);
 
+	bool enable_fog = false;
 	if (cmd_buffer->mode == RENDER_3D) {
 		gl.Enable(GL_DEPTH_TEST);
-		gl.Uniform1i(renderer->shader.enable_fog, true);
+		enable_fog = true;
 	} else if (cmd_buffer->mode == RENDER_2D) {
 		gl.Disable(GL_DEPTH_TEST);
-		gl.Uniform1i(renderer->shader.enable_fog, false);
 	}
 
+	renderer_use_program(renderer, renderer->mesh_shader.program);
+	gl.Uniform1i(renderer->mesh_shader.enable_fog, enable_fog);
+	gl_uniform_m4x4(renderer->mesh_shader.projection, projection);
+	gl_uniform_m4x4(renderer->mesh_shader.view, view);
+
+	renderer_use_program(renderer, renderer->shader.program);
+	gl.Uniform1i(renderer->shader.enable_fog, enable_fog);
 	gl_uniform_v3(renderer->shader.camera_pos, camera_pos);
 	gl_uniform_m4x4(renderer->shader.model, model);
 	gl_uniform_m4x4(renderer->shader.projection, projection);
 	gl_uniform_m4x4(renderer->shader.view, view);
 
-	gl.BindVertexArray(renderer->vertex_array);
-	gl.BindBuffer(GL_ARRAY_BUFFER, renderer->vertex_buffer);
-	gl.BufferData(GL_ARRAY_BUFFER,
-	    cmd_buffer->vertex_count * sizeof(*cmd_buffer->vertex_buffer),
-	    cmd_buffer->vertex_buffer, GL_STREAM_DRAW);
-	gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->index_buffer);
-	gl.BufferData(GL_ELEMENT_ARRAY_BUFFER,
-	    cmd_buffer->index_count * sizeof(*cmd_buffer->index_buffer),
-	    cmd_buffer->index_buffer, GL_STREAM_DRAW);
-
-	while (command_count-- > 0) {
-		struct render_cmd *base_command = (struct render_cmd *)push_buffer;
-		push_buffer += sizeof(*base_command);
+	for (u32 i = 0; i < command_count; i++) {
+		u32 offset = keys[i] & RENDER_KEY_OFFSET_MASK;
+		struct render_cmd *base_command = (struct render_cmd *)(push_buffer + offset);
+		void *command_data = base_command + 1;
 
 		switch (base_command->type) {
 		case RENDER_CLEAR:
 			{
-				struct render_cmd_clear *clear =
-				    (struct render_cmd_clear *)push_buffer;
+				struct render_cmd_clear *clear = command_data;
 
 				v4 color = clear->color;
 				gl.ClearColor(color.r, color.g, color.b, color.a);
 				gl.Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-				push_buffer += sizeof(*clear);
 			}
 			break;
 
 		case RENDER_QUADS:
 			{
-				struct render_cmd_quads *command =
-				    (struct render_cmd_quads *)push_buffer;
+				struct render_cmd_quads *command = command_data;
 
-				usize index_offset = sizeof(u32) * command->index_offset;
+				usize index_offset = sizeof(u32) *
+				    (cmd_buffer->base_index + command->index_offset);
 
-				gl.BindVertexArray(renderer->vertex_array);
+				renderer_use_program(renderer, renderer->shader.program);
+				renderer_bind_vertex_array(renderer, renderer->vertex_array);
 				renderer_bind_texture(renderer, command->texture);
-				gl.DrawElements(GL_TRIANGLES, command->quad_count * 6,
-				    GL_UNSIGNED_INT, (void *)index_offset);
-
-				push_buffer += sizeof(*command);
+				gl.DrawElementsBaseVertex(GL_TRIANGLES, command->quad_count * 6,
+				    GL_UNSIGNED_INT, (void *)index_offset, cmd_buffer->base_vertex);
+				renderer->stats.draw_call_count++;
 			}
 			break;
 
 		case RENDER_MESH:
 			{
-				struct render_cmd_mesh *command =
-				    (struct render_cmd_mesh *)push_buffer;
-
-				struct mesh *mesh = &renderer->meshes[command->mesh];
-
-				gl.BindVertexArray(mesh->vertex_array);
-				renderer_bind_texture(renderer, command->texture);
-				gl_uniform_m4x4(renderer->shader.model, command->transform);
-				gl.DrawElements(GL_TRIANGLES, mesh->index_count,
-				    GL_UNSIGNED_INT, 0);
-
-				push_buffer += sizeof(*command);
+				struct render_cmd_mesh *command = command_data;
+
+				// NOTE: the mesh may have been freed after the command was pushed
+				struct mesh *mesh = renderer_get_mesh(renderer, command->mesh);
+				if (mesh) {
+					renderer_use_program(renderer, renderer->mesh_shader.program);
+					renderer_bind_vertex_array(renderer, renderer->mesh_vertex_array);
+					renderer_bind_texture(renderer, command->texture);
+
+					v3 offset = v3_sub(command->position, camera_pos);
+					gl_uniform_v3(renderer->mesh_shader.offset, offset);
+
+					u32 quad_count = mesh->index_count / 6;
+					for (u32 i = 0; i < quad_count; i += MAX_MESH_QUAD_COUNT) {
+						u32 batch_quad_count = MIN(quad_count - i, MAX_MESH_QUAD_COUNT);
+						gl.DrawElementsBaseVertex(GL_TRIANGLES, batch_quad_count * 6,
+						    GL_UNSIGNED_SHORT, 0, mesh->vertex_offset + i * 4);
+						renderer->stats.draw_call_count++;
+					}
+				}
 			}
 			break;
 
@@ -350,16 +987,28 @@ renderer_submit(struct renderer *renderer, struct render_cmdbuf *cmd_buffer)
 	}
 }
 
+// NOTE: the key contains the bits of the sort key below the pass
 static void *
-push_command(struct render_cmdbuf *cmd_buffer, u32 type)
+push_command(struct render_cmdbuf *cmd_buffer, u32 type, u64 key)
 {
+	u32 offset = cmd_buffer->push_buffer_size;
 	struct render_cmd *command = (struct render_cmd *)
-	    (cmd_buffer->push_buffer + cmd_buffer->push_buffer_size);
+	    (cmd_buffer->push_buffer + offset);
 
 	u32 command_size = render_cmd_size[type];
 
 	assert(type < RENDER_COMMAND_COUNT);
 	assert(command_size != 0);
+	assert(cmd_buffer->command_count < cmd_buffer->max_command_count);
+
+	u64 pass = render_cmd_pass[type];
+	u64 layer = cmd_buffer->layer;
+	cmd_buffer->sort_keys[cmd_buffer->command_count] =
+	    pass << RENDER_KEY_PASS_SHIFT | layer << RENDER_KEY_LAYER_SHIFT |
+	    key | offset;
+	if (type == RENDER_QUADS) {
+		cmd_buffer->layer = MIN(layer + 1, RENDER_KEY_MAX_LAYER);
+	}
 
 	command->type = type;
 	cmd_buffer->push_buffer_size += sizeof(*command);
@@ -374,7 +1023,7 @@ static void
 render_clear(struct render_cmdbuf *cmd_buffer, v4 color)
 {
 	struct render_cmd_clear *clear =
-	    push_command(cmd_buffer, RENDER_CLEAR);
+	    push_command(cmd_buffer, RENDER_CLEAR, 0);
 
 	clear->color = color;
 }
@@ -387,7 +1036,8 @@ render_quad(struct render_cmdbuf *cmd_buffer,
 	struct render_cmd_quads *command = cmd_buffer->current_quads;
 
 	if (!command || command->texture != texture.value) {
-		command = push_command(cmd_buffer, RENDER_QUADS);
+		u64 key = (u64)RENDER_PROGRAM_QUADS << RENDER_KEY_PROGRAM_SHIFT;
+		command = push_command(cmd_buffer, RENDER_QUADS, key);
 		command->texture = texture.value;
 		command->index_offset = cmd_buffer->index_count;
 		command->quad_count = 0;
@@ -426,8 +1076,8 @@ render_quad(struct render_cmdbuf *cmd_buffer,
 	cmd_buffer->index_count += 6;
 	cmd_buffer->vertex_count += 4;
 
-	assert(cmd_buffer->index_count < INDEX_BUFFER_SIZE);
-	assert(cmd_buffer->vertex_count < VERTEX_BUFFER_SIZE);
+	assert(cmd_buffer->index_count <= cmd_buffer->max_index_count);
+	assert(cmd_buffer->vertex_count <= cmd_buffer->max_vertex_count);
 }
 
 static void
@@ -476,11 +1126,18 @@ render_textured_quad(struct render_cmdbuf *cmd_buffer,
 
 static void
 render_mesh(struct render_cmdbuf *cmd_buffer,
-    u32 mesh, m4x4 transform, struct texture_id texture)
+    u32 mesh, v3 position, struct texture_id texture)
 {
-	struct render_cmd_mesh *command = push_command(cmd_buffer, RENDER_MESH);
+	// NOTE: the depth is the distance to the camera in blocks
+	v3 camera_pos = cmd_buffer->transform.camera_pos;
+	u64 depth = MIN(v3_len(v3_sub(position, camera_pos)), 0xffff);
+	u64 key = (u64)RENDER_PROGRAM_MESH << RENDER_KEY_PROGRAM_SHIFT |
+	    (u64)(texture.value & 0xffff) << RENDER_KEY_TEXTURE_SHIFT |
+	    depth << RENDER_KEY_DEPTH_SHIFT;
+
+	struct render_cmd_mesh *command = push_command(cmd_buffer, RENDER_MESH, key);
 
 	command->mesh = mesh;
 	command->texture = texture.value;
-	command->transform = transform;
+	command->position = position;
 }
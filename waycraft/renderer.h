@@ -3,6 +3,28 @@ struct vertex {
 	v2 texcoord;
 };
 
+/*
+ * NOTE: the vertices of meshes are packed into 32 bits. The position is
+ * relative to the origin of the mesh and has five bits per axis, followed by
+ * three bits for the face, one bit for lowering the vertex and eight bits for
+ * the tile in the texture atlas. The texture coordinates are derived from the
+ * position and the face in the shader.
+ */
+struct mesh_vertex {
+	u32 packed;
+};
+
+struct mesh_buffer {
+	struct mesh_vertex *vertices;
+	u32 vertex_count;
+	u32 max_vertex_count;
+};
+
+// NOTE: the fog starts at the fog distance minus the fog width and fragments
+// at the fog distance or farther only have the color of the fog.
+#define FOG_DISTANCE 256
+#define FOG_WIDTH 10
+
 enum render_mode {
 	RENDER_3D,
 	RENDER_2D,
@@ -15,6 +37,35 @@ enum render_cmd_type {
 	RENDER_COMMAND_COUNT
 };
 
+/*
+ * NOTE: the commands are executed in the order of their sort keys. The key
+ * contains the pass in the highest bits, followed by the layer, the program,
+ * the texture, the depth bucket and the offset of the command in the push
+ * buffer. Every quads command ends a layer, so the quads are drawn in the
+ * order in which they were pushed, also relative to the meshes. Only the
+ * meshes between two quads commands are sorted by their program, texture and
+ * depth. The meshes are drawn front to back, so that the depth test can
+ * discard hidden fragments early. Once the last layer is reached, all
+ * further commands stay in it.
+ */
+enum render_pass {
+	RENDER_PASS_CLEAR,
+	RENDER_PASS_DRAW,
+};
+
+enum render_program {
+	RENDER_PROGRAM_MESH,
+	RENDER_PROGRAM_QUADS,
+};
+
+#define RENDER_KEY_PASS_SHIFT 62
+#define RENDER_KEY_LAYER_SHIFT 58
+#define RENDER_KEY_MAX_LAYER 15
+#define RENDER_KEY_PROGRAM_SHIFT 56
+#define RENDER_KEY_TEXTURE_SHIFT 40
+#define RENDER_KEY_DEPTH_SHIFT 24
+#define RENDER_KEY_OFFSET_MASK ((1 << RENDER_KEY_DEPTH_SHIFT) - 1)
+
 struct render_cmd {
 	enum render_cmd_type type;
 };
@@ -32,7 +83,7 @@ struct render_cmd_quads {
 struct render_cmd_mesh {
 	u32 mesh;
 	u32 texture;
-	m4x4 transform;
+	v3 position;
 };
 
 struct render_transform {
@@ -47,12 +98,21 @@ struct render_cmdbuf {
 	enum render_mode mode;
 
 	u32 command_count;
+	u32 max_command_count;
+	u64 *sort_keys;
+	u64 *sort_buffer;
 	u8 *push_buffer;
 	u32 push_buffer_size;
 	u32 max_push_buffer_size;
+	u32 layer;
 
+	// NOTE: the vertices and indices are written directly into the stream
+	// of the renderer, the base is the first vertex and index of the
+	// command buffer in the stream.
 	struct vertex *vertex_buffer;
 	u32 *index_buffer;
+	u32 base_vertex;
+	u32 base_index;
 	u32 vertex_count;
 	u32 index_count;
 	u32 max_vertex_count;
@@ -62,12 +122,113 @@ struct render_cmdbuf {
 	struct game_assets *assets;
 };
 
-struct mesh {
-	u32 vertex_array;
-	u32 vertex_buffer;
-	u32 index_buffer;
+/*
+ * NOTE: the vertices and indices of the quads are streamed through one region
+ * of the stream buffers per frame. The command buffers of a frame share the
+ * region of the frame. A region is only written again once the fence of its
+ * frame has signaled, so the GPU is never waiting for the buffers.
+ */
+#define RENDER_STREAM_FRAME_COUNT 3
+#define RENDER_STREAM_VERTEX_COUNT (8 * 1024)
+#define RENDER_STREAM_INDEX_COUNT (12 * 1024)
 
+/*
+ * NOTE: the stream buffers stay mapped if persistent mappings are supported,
+ * otherwise the region of the frame is mapped unsynchronized at the start of
+ * the frame and unmapped before the first command buffer is submitted. All
+ * command buffers of a frame have to be filled before the first one is
+ * submitted. The vertices and indices point to the region of the current
+ * frame.
+ */
+struct render_stream {
+	struct vertex *mapped_vertices;
+	u32 *mapped_indices;
+	struct vertex *vertices;
+	u32 *indices;
+	u32 vertex_count;
 	u32 index_count;
+	u32 frame;
+	bool is_persistent;
+	bool is_mapped;
+	GLsync fences[RENDER_STREAM_FRAME_COUNT];
+};
+
+// NOTE: the vertex buffer of the meshes grows when it is full
+#define DEFAULT_MESH_VERTEX_BUFFER_SIZE MB(16)
+
+// NOTE: allocations are rounded up to a multiple of this vertex count, so
+// that slightly larger meshes still fit into the range of the old mesh.
+#define MESH_VERTEX_GRANULARITY 64
+
+// NOTE: the meshes evict the farthest chunks once they use more memory
+#define DEFAULT_MESH_MEMORY_BUDGET MB(64)
+
+/*
+ * NOTE: a mesh handle contains the index of the mesh in the lower bits and
+ * the generation of the mesh in the upper bits. The generation is incremented
+ * whenever a mesh is freed, so that old handles no longer refer to the mesh
+ * that reuses the index. The generation wraps around within its bits. The
+ * first index is never used, so zero is never a valid handle.
+ */
+#define MESH_INDEX_BITS 16
+#define MAX_MESH_COUNT (1 << MESH_INDEX_BITS)
+#define MESH_GENERATION_MASK ((1u << (32 - MESH_INDEX_BITS)) - 1)
+
+/*
+ * NOTE: the vertices of all meshes are stored in one vertex buffer and all
+ * meshes share the quad index buffer of the renderer. The offset and capacity
+ * of a mesh are in vertices. The next free mesh is only used by free meshes.
+ */
+struct mesh {
+	u32 vertex_offset;
+	u32 vertex_capacity;
+	u32 index_count;
+	u32 generation;
+	u32 next_free;
+	bool is_used;
+};
+
+struct mesh_range {
+	u32 offset;
+	u32 size;
+};
+
+/*
+ * NOTE: the free ranges of the vertex buffer are sorted by their offset and
+ * adjacent ranges are merged when a mesh is freed. Meshes are allocated from
+ * the smallest free range that fits them. All sizes are in vertices.
+ */
+struct mesh_allocator {
+	struct mesh_range *free_ranges;
+	u32 free_range_count;
+	u32 max_free_range_count;
+	u32 used_vertex_count;
+	u32 max_vertex_count;
+};
+
+/*
+ * NOTE: the fragmentation is the fraction of the free memory that is not
+ * part of the largest free range. All sizes are in bytes.
+ */
+struct mesh_stats {
+	usize size;
+	usize used;
+	usize free;
+	usize largest_free_range;
+	u32 free_range_count;
+	u32 mesh_count;
+	f32 fragmentation;
+};
+
+/*
+ * NOTE: the state changes that were skipped because the state was already
+ * bound are counted for each frame.
+ */
+struct render_stats {
+	u32 command_count;
+	u32 draw_call_count;
+	u32 state_change_count;
+	u32 skipped_state_change_count;
 };
 
 struct renderer {
@@ -77,6 +238,11 @@ struct renderer {
 	u32 vertex_array;
 	u32 vertex_buffer;
 	u32 index_buffer;
+	struct render_stream stream;
+	u32 quad_index_buffer;
+	u32 mesh_vertex_array;
+	u32 mesh_vertex_buffer;
+	struct mesh_allocator mesh_allocator;
 
 	struct {
 		u32 program;
@@ -87,9 +253,29 @@ struct renderer {
 		i32 enable_fog;
 	} shader;
 
+	struct {
+		u32 program;
+		i32 offset;
+		i32 view;
+		i32 projection;
+		i32 enable_fog;
+	} mesh_shader;
+
 	struct mesh *meshes;
 	u32 max_mesh_count;
 	u32 mesh_count;
+	u32 used_mesh_count;
+	u32 first_free_mesh;
+	usize mesh_memory_budget;
+
+	// NOTE: the state that is currently bound, zero means the state is unknown
+	struct {
+		u32 program;
+		u32 vertex_array;
+		u32 texture;
+	} bound;
+
+	struct render_stats stats;
 };
 
 struct arena;
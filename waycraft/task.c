@@ -0,0 +1,589 @@
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <waycraft/task.h>
+
+// NOTE: the index of the worker of the current thread, the main thread is
+// the first worker.
+static _Thread_local u32 current_worker;
+
+// NOTE: returns the time in nanoseconds
+static u64
+get_task_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	u64 result = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	return result;
+}
+
+static void
+task_deque_push(struct platform_task_deque *deque, u32 task)
+{
+	i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+	i64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	assert(bottom - top < (i64)LENGTH(deque->tasks));
+
+	u32 *entry = &deque->tasks[bottom & (LENGTH(deque->tasks) - 1)];
+	__atomic_store_n(entry, task, __ATOMIC_RELAXED);
+	__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+}
+
+// NOTE: only the owner of the deque can pop tasks, the last task is taken
+// from the thieves with the same compare and swap as a steal.
+static u32
+task_deque_pop(struct platform_task_deque *deque)
+{
+	i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+	__atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	i64 top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+	u32 result = TASK_NONE;
+	if (top <= bottom) {
+		u32 *entry = &deque->tasks[bottom & (LENGTH(deque->tasks) - 1)];
+		result = __atomic_load_n(entry, __ATOMIC_RELAXED);
+		if (top == bottom) {
+			if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1,
+			        false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+				result = TASK_NONE;
+			}
+
+			__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+		}
+	} else {
+		__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+	}
+
+	return result;
+}
+
+// NOTE: returns no task if the deque is empty or another thread took the
+// task first.
+static u32
+task_deque_steal(struct platform_task_deque *deque)
+{
+	i64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+	u32 result = TASK_NONE;
+	if (top < bottom) {
+		u32 *entry = &deque->tasks[top & (LENGTH(deque->tasks) - 1)];
+		result = __atomic_load_n(entry, __ATOMIC_RELAXED);
+		if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1,
+		        false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+			result = TASK_NONE;
+		}
+	}
+
+	return result;
+}
+
+static struct platform_task *
+get_task(struct platform_task_queue *queue, u32 index)
+{
+	u32 worker = index / MAX_WORKER_TASK_COUNT;
+	u32 slot = index % MAX_WORKER_TASK_COUNT;
+	assert(worker < queue->worker_count);
+
+	struct platform_task *task = &queue->workers[worker].tasks[slot];
+	return task;
+}
+
+static bool
+is_task_finished(struct platform_task_queue *queue, u32 handle)
+{
+	bool result = true;
+
+	if (handle) {
+		u32 index = handle & ((1 << TASK_INDEX_BITS) - 1);
+		u32 generation = handle >> TASK_INDEX_BITS;
+		struct platform_task *task = get_task(queue, index);
+
+		// NOTE: the unfinished count is loaded first, the generation is
+		// always updated before a reused task becomes unfinished.
+		i32 unfinished_count = __atomic_load_n(&task->unfinished_count, __ATOMIC_SEQ_CST);
+		result = unfinished_count == 0 ||
+		    __atomic_load_n(&task->generation, __ATOMIC_ACQUIRE) != generation;
+	}
+
+	return result;
+}
+
+/*
+ * NOTE: creates an unfinished task in the pool of the current thread. The
+ * parent must not be finished, it stays unfinished until the new task is
+ * finished. The task gets the priority of its parent if the parent has a
+ * higher priority, so that waiting for the parent never waits for tasks with
+ * a lower priority. Returns the handle of the task.
+ */
+static u32
+create_task(struct platform_task_queue *queue, u32 parent, u32 priority,
+    platform_task_callback_t *callback, platform_range_callback_t *range_callback,
+    void *data, u32 start, u32 end)
+{
+	struct platform_worker *worker = &queue->workers[current_worker];
+
+	// NOTE: tasks are usually finished in the order in which they were
+	// created, so the next slot is almost always free.
+	struct platform_task *task = NULL;
+	for (u32 i = 0; i < MAX_WORKER_TASK_COUNT; i++) {
+		u32 slot = worker->next_task++ % MAX_WORKER_TASK_COUNT;
+		struct platform_task *candidate = &worker->tasks[slot];
+		if (__atomic_load_n(&candidate->unfinished_count, __ATOMIC_ACQUIRE) == 0) {
+			task = candidate;
+			break;
+		}
+	}
+
+	assert(task);
+
+	u32 generation = (task->generation + 1) & 0xffff;
+	if (generation == 0) {
+		generation = 1;
+	}
+
+	struct platform_task *parent_task = NULL;
+	if (parent) {
+		assert(!is_task_finished(queue, parent));
+
+		u32 parent_index = parent & ((1 << TASK_INDEX_BITS) - 1);
+		parent_task = get_task(queue, parent_index);
+		priority = MIN(priority, parent_task->priority);
+	}
+
+	assert(priority < PLATFORM_TASK_PRIORITY_COUNT);
+
+	__atomic_store_n(&task->generation, generation, __ATOMIC_RELEASE);
+	task->callback = callback;
+	task->range_callback = range_callback;
+	task->data = data;
+	task->start = start;
+	task->end = end;
+	task->parent = parent;
+	task->priority = priority;
+	task->queued_time = get_task_time();
+	__atomic_store_n(&task->unfinished_count, 1, __ATOMIC_RELEASE);
+
+	if (parent_task) {
+		__atomic_add_fetch(&parent_task->unfinished_count, 1, __ATOMIC_SEQ_CST);
+	}
+
+	__atomic_add_fetch(&queue->unfinished_task_count, 1, __ATOMIC_SEQ_CST);
+
+	u32 index = worker->index * MAX_WORKER_TASK_COUNT + (task - worker->tasks);
+	u32 result = generation << TASK_INDEX_BITS | index;
+	return result;
+}
+
+/*
+ * NOTE: a thread only goes to sleep if all deques are empty after it
+ * incremented the sleeping count. Adding a task only takes the lock to wake
+ * up a thread if there is a sleeping thread.
+ */
+static void
+push_task(struct platform_task_queue *queue, u32 handle)
+{
+	struct platform_worker *worker = &queue->workers[current_worker];
+	u32 index = handle & ((1 << TASK_INDEX_BITS) - 1);
+	struct platform_task *task = get_task(queue, index);
+	task_deque_push(&worker->deques[task->priority], index);
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&queue->sleeping_count, __ATOMIC_SEQ_CST) > 0) {
+		pthread_mutex_lock(&queue->lock);
+		pthread_cond_signal(&queue->new_task);
+		pthread_mutex_unlock(&queue->lock);
+	}
+}
+
+/*
+ * NOTE: finishes the task itself or one of its children. The parent of the
+ * task is loaded first, because the slot can be reused once it is finished.
+ * The waiting count of the slot is never reset, a reused slot at worst wakes
+ * up the waiting threads once too often.
+ */
+static void
+finish_task(struct platform_task_queue *queue, u32 index)
+{
+	struct platform_task *task = get_task(queue, index);
+	u32 parent = task->parent;
+
+	if (__atomic_sub_fetch(&task->unfinished_count, 1, __ATOMIC_SEQ_CST) == 0) {
+		if (parent) {
+			finish_task(queue, parent & ((1 << TASK_INDEX_BITS) - 1));
+		}
+
+		// NOTE: the threads that complete all tasks only have to be woken
+		// up once the last task is finished.
+		bool is_last_task = __atomic_sub_fetch(&queue->unfinished_task_count,
+		    1, __ATOMIC_SEQ_CST) == 0;
+		if ((is_last_task && __atomic_load_n(&queue->waiting_count, __ATOMIC_SEQ_CST) > 0) ||
+		        __atomic_load_n(&task->waiting_count, __ATOMIC_SEQ_CST) > 0) {
+			pthread_mutex_lock(&queue->lock);
+			pthread_cond_broadcast(&queue->task_done);
+			pthread_mutex_unlock(&queue->lock);
+		}
+	}
+}
+
+/*
+ * NOTE: returns the number of priorities whose tasks the workers can execute.
+ * The background tasks are skipped once the background time of the frame
+ * exceeds the quota.
+ */
+static u32
+get_runnable_priority_count(struct platform_task_queue *queue)
+{
+	u32 result = PLATFORM_TASK_PRIORITY_COUNT;
+
+	u64 quota = __atomic_load_n(&queue->background_quota, __ATOMIC_RELAXED);
+	if (quota != 0 && __atomic_load_n(&queue->background_time, __ATOMIC_SEQ_CST) >= quota) {
+		result = PLATFORM_TASK_BACKGROUND;
+	}
+
+	return result;
+}
+
+// NOTE: the deques can contain tasks that were already taken by a thread
+// that is still popping or stealing them.
+static bool
+has_queued_tasks(struct platform_task_queue *queue, u32 priority_count)
+{
+	bool result = false;
+
+	for (u32 i = 0; !result && i < queue->worker_count; i++) {
+		for (u32 priority = 0; !result && priority < priority_count; priority++) {
+			struct platform_task_deque *deque = &queue->workers[i].deques[priority];
+			i64 top = __atomic_load_n(&deque->top, __ATOMIC_SEQ_CST);
+			i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_SEQ_CST);
+			result = top < bottom;
+		}
+	}
+
+	return result;
+}
+
+/*
+ * NOTE: executes a task with one of the first priorities. The tasks of a
+ * priority are popped from the deque of the current thread or stolen from
+ * another thread before the next priority is tried. The victims are tried in
+ * order, starting from a random thread.
+ */
+static bool
+execute_task(struct platform_task_queue *queue, u32 priority_count)
+{
+	struct platform_worker *worker = &queue->workers[current_worker];
+	u32 worker_count = queue->worker_count;
+
+	u32 x = worker->random_state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	worker->random_state = x;
+
+	u32 index = TASK_NONE;
+	for (u32 priority = 0; index == TASK_NONE && priority < priority_count; priority++) {
+		index = task_deque_pop(&worker->deques[priority]);
+		for (u32 i = 0; index == TASK_NONE && i < worker_count; i++) {
+			u32 victim = (x + i) % worker_count;
+			if (victim != worker->index) {
+				index = task_deque_steal(&queue->workers[victim].deques[priority]);
+			}
+		}
+	}
+
+	bool executed_task = false;
+	if (index != TASK_NONE) {
+		executed_task = true;
+
+		struct platform_task *task = get_task(queue, index);
+		u64 start_time = get_task_time();
+		u64 latency = start_time - task->queued_time;
+
+		struct platform_worker_stats *stats = &worker->stats[task->priority];
+		__atomic_store_n(&stats->executed_count, stats->executed_count + 1, __ATOMIC_RELAXED);
+		__atomic_store_n(&stats->total_latency, stats->total_latency + latency, __ATOMIC_RELAXED);
+		__atomic_store_n(&stats->max_latency, MAX(stats->max_latency, latency), __ATOMIC_RELAXED);
+
+		// NOTE: a task can execute other tasks while it waits, so the
+		// scratch arena is only reset to where it was before the task.
+		struct arena *scratch = &worker->scratch;
+		struct arena_temp temp = arena_begin_temp(scratch);
+
+		bool is_background = task->priority == PLATFORM_TASK_BACKGROUND;
+		if (task->range_callback) {
+			task->range_callback(task->data, task->start, task->end, scratch);
+		} else if (task->callback) {
+			task->callback(task->data, scratch);
+		}
+
+		__atomic_store_n(&worker->scratch_high_water, scratch->peak, __ATOMIC_RELAXED);
+		arena_end_temp(temp);
+
+		if (is_background) {
+			u64 time = get_task_time() - start_time;
+			__atomic_add_fetch(&queue->background_time, time, __ATOMIC_SEQ_CST);
+		}
+
+		finish_task(queue, index);
+	}
+
+	return executed_task;
+}
+
+static void *
+thread_proc(void *data)
+{
+	struct platform_worker *worker = data;
+	struct platform_task_queue *queue = worker->queue;
+	current_worker = worker->index;
+
+	sigset_t signal_set;
+	sigemptyset(&signal_set);
+	sigaddset(&signal_set, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &signal_set, NULL);
+
+	// NOTE: the thread yields if the tasks in the deques are still being
+	// taken by other threads and only sleeps once there are no tasks left
+	// that it could execute.
+	for (;;) {
+		if (execute_task(queue, get_runnable_priority_count(queue))) {
+			continue;
+		}
+
+		if (has_queued_tasks(queue, get_runnable_priority_count(queue))) {
+			sched_yield();
+		} else {
+			pthread_mutex_lock(&queue->lock);
+			__atomic_add_fetch(&queue->sleeping_count, 1, __ATOMIC_SEQ_CST);
+			while (!has_queued_tasks(queue, get_runnable_priority_count(queue))) {
+				pthread_cond_wait(&queue->new_task, &queue->lock);
+			}
+
+			__atomic_sub_fetch(&queue->sleeping_count, 1, __ATOMIC_SEQ_CST);
+			pthread_mutex_unlock(&queue->lock);
+		}
+	}
+
+	return NULL;
+}
+
+// NOTE: the thread count includes the main thread, which has to be the
+// thread that initializes the queue.
+static void
+task_queue_init(struct platform_task_queue *queue, u32 thread_count)
+{
+	i32 result = 0;
+
+	result = pthread_mutex_init(&queue->lock, NULL);
+	assert(result == 0);
+
+	result = pthread_cond_init(&queue->new_task, NULL);
+	assert(result == 0);
+
+	result = pthread_cond_init(&queue->task_done, NULL);
+	assert(result == 0);
+
+	queue->worker_count = MIN(thread_count, MAX_WORKER_COUNT);
+	queue->workers = aligned_alloc(_Alignof(struct platform_worker),
+	    queue->worker_count * sizeof(*queue->workers));
+	assert(queue->workers);
+
+	memset(queue->workers, 0, queue->worker_count * sizeof(*queue->workers));
+	for (u32 i = 0; i < queue->worker_count; i++) {
+		struct platform_worker *worker = &queue->workers[i];
+		worker->queue = queue;
+		worker->index = i;
+		worker->random_state = 2654435761u * (i + 1);
+		worker->scratch = arena_reserve(WORKER_SCRATCH_SIZE);
+		assert(worker->scratch.data);
+	}
+
+	current_worker = 0;
+	for (u32 i = 1; i < queue->worker_count; i++) {
+		struct platform_worker *worker = &queue->workers[i];
+		result = pthread_create(&worker->thread, NULL, thread_proc, worker);
+		assert(result == 0);
+
+		pthread_detach(worker->thread);
+	}
+}
+
+static u32
+add_task(struct platform_task_queue *queue, enum platform_task_priority priority,
+    platform_task_callback_t *callback, void *data)
+{
+	u32 task = create_task(queue, 0, priority, callback, NULL, data, 0, 0);
+	push_task(queue, task);
+	return task;
+}
+
+static u32
+add_child_task(struct platform_task_queue *queue, u32 parent,
+    enum platform_task_priority priority, platform_task_callback_t *callback,
+    void *data)
+{
+	u32 task = create_task(queue, parent, priority, callback, NULL, data, 0, 0);
+	push_task(queue, task);
+	return task;
+}
+
+/*
+ * NOTE: executes tasks on the calling thread until the task is finished. The
+ * thread only executes tasks with at least the priority of the task and
+ * ignores the background quota, because the task could otherwise wait for
+ * the next frame. The thread only sleeps if there are no tasks left that it
+ * could execute.
+ */
+static void
+wait_task(struct platform_task_queue *queue, u32 task)
+{
+	if (is_task_finished(queue, task)) {
+		return;
+	}
+
+	u32 index = task & ((1 << TASK_INDEX_BITS) - 1);
+	struct platform_task *waited_task = get_task(queue, index);
+	u32 priority_count = waited_task->priority + 1;
+
+	while (!is_task_finished(queue, task)) {
+		if (execute_task(queue, priority_count)) {
+			continue;
+		}
+
+		if (has_queued_tasks(queue, priority_count)) {
+			sched_yield();
+		} else {
+			pthread_mutex_lock(&queue->lock);
+			__atomic_add_fetch(&waited_task->waiting_count, 1, __ATOMIC_SEQ_CST);
+			while (!is_task_finished(queue, task) &&
+			        !has_queued_tasks(queue, priority_count)) {
+				pthread_cond_wait(&queue->task_done, &queue->lock);
+			}
+
+			__atomic_sub_fetch(&waited_task->waiting_count, 1, __ATOMIC_SEQ_CST);
+			pthread_mutex_unlock(&queue->lock);
+		}
+	}
+}
+
+/*
+ * NOTE: calls the callback for each range of at most the batch size in
+ * parallel and waits until all of them have returned. The ranges are the
+ * children of a task that is only used for waiting.
+ */
+static void
+parallel_for(struct platform_task_queue *queue, enum platform_task_priority priority,
+    platform_range_callback_t *callback, void *data, u32 count, u32 batch_size)
+{
+	batch_size = MAX(batch_size, 1);
+	batch_size = MAX(batch_size, (count + MAX_PARALLEL_FOR_TASK_COUNT - 1) /
+	    MAX_PARALLEL_FOR_TASK_COUNT);
+
+	u32 root = create_task(queue, 0, priority, NULL, NULL, NULL, 0, 0);
+	for (u32 start = 0; start < count; start += batch_size) {
+		u32 end = MIN(start + batch_size, count);
+		u32 task = create_task(queue, root, priority, NULL, callback, data, start, end);
+		push_task(queue, task);
+	}
+
+	finish_task(queue, root & ((1 << TASK_INDEX_BITS) - 1));
+	wait_task(queue, root);
+}
+
+// NOTE: ignores the background quota, like waiting for a task
+static void
+complete_all_tasks(struct platform_task_queue *queue)
+{
+	u32 priority_count = PLATFORM_TASK_PRIORITY_COUNT;
+
+	while (__atomic_load_n(&queue->unfinished_task_count, __ATOMIC_SEQ_CST) != 0) {
+		if (execute_task(queue, priority_count)) {
+			continue;
+		}
+
+		if (has_queued_tasks(queue, priority_count)) {
+			sched_yield();
+		} else {
+			pthread_mutex_lock(&queue->lock);
+			__atomic_add_fetch(&queue->waiting_count, 1, __ATOMIC_SEQ_CST);
+			while (__atomic_load_n(&queue->unfinished_task_count, __ATOMIC_SEQ_CST) != 0 &&
+			        !has_queued_tasks(queue, priority_count)) {
+				pthread_cond_wait(&queue->task_done, &queue->lock);
+			}
+
+			__atomic_sub_fetch(&queue->waiting_count, 1, __ATOMIC_SEQ_CST);
+			pthread_mutex_unlock(&queue->lock);
+		}
+	}
+}
+
+static void
+set_background_quota(struct platform_task_queue *queue, f64 quota)
+{
+	__atomic_store_n(&queue->background_quota, (u64)(quota * 1e9), __ATOMIC_RELAXED);
+}
+
+// NOTE: called by the platform at the start of each frame, wakes up the
+// workers if they were sleeping because of the background quota.
+static void
+task_queue_begin_frame(struct platform_task_queue *queue)
+{
+	__atomic_store_n(&queue->background_time, 0, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&queue->sleeping_count, __ATOMIC_SEQ_CST) > 0 &&
+	        has_queued_tasks(queue, PLATFORM_TASK_PRIORITY_COUNT)) {
+		pthread_mutex_lock(&queue->lock);
+		pthread_cond_broadcast(&queue->new_task);
+		pthread_mutex_unlock(&queue->lock);
+	}
+}
+
+static void
+get_task_stats(struct platform_task_queue *queue, struct platform_task_stats *stats)
+{
+	for (u32 priority = 0; priority < PLATFORM_TASK_PRIORITY_COUNT; priority++) {
+		u64 total_latency = 0;
+		u64 max_latency = 0;
+
+		struct platform_task_stats *result = &stats[priority];
+		memset(result, 0, sizeof(*result));
+		for (u32 i = 0; i < queue->worker_count; i++) {
+			struct platform_worker *worker = &queue->workers[i];
+			struct platform_task_deque *deque = &worker->deques[priority];
+			i64 top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+			i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+			result->queued_count += MAX(bottom - top, 0);
+
+			struct platform_worker_stats *worker_stats = &worker->stats[priority];
+			result->executed_count += __atomic_load_n(&worker_stats->executed_count, __ATOMIC_RELAXED);
+			total_latency += __atomic_load_n(&worker_stats->total_latency, __ATOMIC_RELAXED);
+			max_latency = MAX(max_latency,
+			    __atomic_load_n(&worker_stats->max_latency, __ATOMIC_RELAXED));
+		}
+
+		result->total_latency = total_latency * 1e-9;
+		result->max_latency = max_latency * 1e-9;
+	}
+}
+
+static u32
+get_scratch_stats(struct platform_task_queue *queue,
+    struct platform_scratch_stats *stats, u32 max_count)
+{
+	u32 count = MIN(queue->worker_count, max_count);
+	for (u32 i = 0; i < count; i++) {
+		struct platform_worker *worker = &queue->workers[i];
+		stats[i].size = worker->scratch.reserved;
+		stats[i].high_water = __atomic_load_n(&worker->scratch_high_water,
+		    __ATOMIC_RELAXED);
+	}
+
+	return queue->worker_count;
+}
@@ -0,0 +1,105 @@
+/*
+ * NOTE: every thread has a deque of tasks for each priority and a pool of
+ * tasks. The main thread is the first worker. A thread pushes and pops the
+ * tasks that it adds at the bottom of its own deques, the other threads steal
+ * tasks from the top of its deques once they run out of tasks. The deques of
+ * a priority are drained before the deques of the next priority. Only the
+ * main thread and the worker threads can add tasks.
+ */
+#define MAX_WORKER_COUNT 64
+#define MAX_WORKER_TASK_COUNT 1024
+#define TASK_INDEX_BITS 16
+#define TASK_NONE 0xffffffff
+
+// NOTE: the address space that is reserved for the scratch arena of each
+// thread, its memory is only committed once a task uses it.
+#define WORKER_SCRATCH_SIZE MB(16)
+
+// NOTE: parallel for splits the range into at most this many tasks
+#define MAX_PARALLEL_FOR_TASK_COUNT 256
+
+static_assert((MAX_WORKER_TASK_COUNT & (MAX_WORKER_TASK_COUNT - 1)) == 0,
+    "The size of a deque must be a power of two");
+static_assert(MAX_WORKER_COUNT * MAX_WORKER_TASK_COUNT <= (1 << TASK_INDEX_BITS),
+    "The index of a task must fit into the handle");
+
+/*
+ * NOTE: a task is finished once its callback has returned and all of its
+ * children are finished. The unfinished count is one for the task itself
+ * plus one for each child that is not finished yet. The slot of a task is
+ * only reused once the task is finished. A task handle contains the index of
+ * the task in the lower bits and the generation of the task in the upper
+ * bits, so that the handles of finished tasks stay finished when the slot is
+ * reused. Zero is never a valid handle. The waiting count is the number of
+ * threads that sleep until the task is finished. A child has at least the
+ * priority of its parent. The queued time is in nanoseconds.
+ */
+struct platform_task {
+	platform_task_callback_t *callback;
+	platform_range_callback_t *range_callback;
+	void *data;
+	u32 start;
+	u32 end;
+	u32 parent;
+	u32 priority;
+	u32 generation;
+	i32 unfinished_count;
+	i32 waiting_count;
+	u64 queued_time;
+};
+
+/*
+ * NOTE: a Chase-Lev deque with a fixed size. The top and the bottom only
+ * increase, the tasks between them are the indices of the queued tasks.
+ */
+struct platform_task_deque {
+	_Alignas(64) i64 top;
+	_Alignas(64) i64 bottom;
+	u32 tasks[MAX_WORKER_TASK_COUNT];
+};
+
+// NOTE: the statistics of the tasks that a worker executed, the times are
+// in nanoseconds. Only the worker itself writes them.
+struct platform_worker_stats {
+	u64 executed_count;
+	u64 total_latency;
+	u64 max_latency;
+};
+
+struct platform_worker {
+	struct platform_task_deque deques[PLATFORM_TASK_PRIORITY_COUNT];
+	struct platform_task tasks[MAX_WORKER_TASK_COUNT];
+	struct platform_worker_stats stats[PLATFORM_TASK_PRIORITY_COUNT];
+	struct arena scratch;
+	usz scratch_high_water;
+	struct platform_task_queue *queue;
+	pthread_t thread;
+	u32 index;
+	u32 next_task;
+	u32 random_state;
+};
+
+/*
+ * NOTE: the unfinished task count is the number of tasks that are not
+ * finished. The lock is only used by threads that go to sleep and the
+ * threads that wake them up. Threads without tasks sleep until a task is
+ * added, threads that wait for a task sleep until the task is finished. The
+ * waiting count is the number of threads that sleep until all tasks are
+ * finished. The workers stop executing background tasks once the background
+ * time of the frame exceeds the background quota, unless the quota is zero.
+ * The times are in nanoseconds.
+ */
+struct platform_task_queue {
+	struct platform_worker *workers;
+	u32 worker_count;
+
+	i32 unfinished_task_count;
+	i32 sleeping_count;
+	i32 waiting_count;
+	u64 background_quota;
+	u64 background_time;
+
+	pthread_mutex_t lock;
+	pthread_cond_t new_task;
+	pthread_cond_t task_done;
+};
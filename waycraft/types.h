@@ -75,6 +75,8 @@ typedef struct box3 {
 #define MAX(a, b) ((a) > (b)? (a) : (b))
 #define SIGN(x)   ((x) < 0? -1 : 1)
 #define LENGTH(x) (sizeof(x)/sizeof((x)[0]))
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
 #define CLAMP(x, min, max) ((x) < (min) ? (min) : (x) > (max) ? (max) : (x))
 #define CLAMP01(x) CLAMP(x, 0, 1)
 
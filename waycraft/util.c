@@ -1,5 +1,7 @@
 #include <time.h>
 #include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
 
 static f64
 get_time_sec(void)
@@ -10,34 +12,6 @@ get_time_sec(void)
 	return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
-static struct arena
-arena_init(void *data, u64 size)
-{
-	struct arena arena = {0};
-	arena.data = data;
-	arena.size = size;
-	arena.used = 0;
-	return arena;
-}
-
-static void *
-alloc(struct arena *arena, usz count, usz size)
-{
-	assert(arena->used + count * size < arena->size);
-	void *ptr = arena->data + arena->used;
-	arena->used += count * size;
-	return ptr;
-}
-
-static struct arena
-arena_create(usz size, struct arena *arena)
-{
-	struct arena result;
-	result.data = alloc(arena, 1, size);
-	result.size = size;
-	return result;
-}
-
 static i32 timer_initialized = 0;
 static FILE *timer_output;
 
@@ -128,3 +102,145 @@ log_(enum log_level level, const char *file, u32 line, const char *func,
 		fputc('\n', stderr);
 	}
 }
+
+static struct arena
+arena_init(void *data, usz size)
+{
+	struct arena arena = {0};
+	arena.data = data;
+	arena.size = size;
+	return arena;
+}
+
+/*
+ * NOTE: only reserves the address space of the arena, the memory is
+ * committed once it is allocated. The arena has no data if the address space
+ * could not be reserved. Only the platform reserves arenas, the game only
+ * commits the memory of the arenas that it gets from the platform.
+ */
+static inline struct arena
+arena_reserve(usz size)
+{
+	struct arena arena = {0};
+
+	size = (size + ARENA_COMMIT_SIZE - 1) & ~(ARENA_COMMIT_SIZE - 1);
+	void *data = mmap(0, size, PROT_NONE,
+	    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (data == MAP_FAILED) {
+		log_err("Failed to reserve %lu bytes:", (unsigned long)size);
+	} else {
+		arena.data = data;
+		arena.reserved = size;
+	}
+
+	return arena;
+}
+
+// NOTE: commits enough memory to allocate the size at the offset
+static bool
+arena_commit(struct arena *arena, usz offset, usz size)
+{
+	if (offset > arena->reserved || size > arena->reserved - offset) {
+		return false;
+	}
+
+	usz new_size = (offset + size + ARENA_COMMIT_SIZE - 1) & ~(ARENA_COMMIT_SIZE - 1);
+	if (mprotect(arena->data + arena->size, new_size - arena->size,
+	        PROT_READ | PROT_WRITE) != 0) {
+		log_err("Failed to commit %lu bytes:",
+		    (unsigned long)(new_size - arena->size));
+		return false;
+	}
+
+	arena->size = new_size;
+	return true;
+}
+
+/*
+ * NOTE: returns zero if the arena is full. The alignment has to be a power
+ * of two, it is relative to the address and not to the start of the arena.
+ */
+static void *
+arena_alloc(struct arena *arena, usz size, usz align)
+{
+	assert(align > 0 && (align & (align - 1)) == 0);
+
+	usz address = (usz)arena->data + arena->used;
+	usz offset = arena->used + (-address & (align - 1));
+	if (offset > arena->size || size > arena->size - offset) {
+		if (!arena_commit(arena, offset, size)) {
+			return 0;
+		}
+	}
+
+	arena->used = offset + size;
+	arena->peak = MAX(arena->peak, arena->used);
+	arena->allocation_count++;
+	return arena->data + offset;
+}
+
+// NOTE: the game can't continue without the memory, so running out of
+// memory is fatal.
+static void *
+alloc(struct arena *arena, usz count, usz size, usz align)
+{
+	void *result = 0;
+	if (size == 0 || count <= (usz)-1 / size) {
+		result = arena_alloc(arena, count * size, align);
+	}
+
+	if (!result) {
+		log_err("Out of memory: %lu of %lu bytes used, %lu times %lu "
+		    "bytes requested", (unsigned long)arena->used,
+		    (unsigned long)arena->size, (unsigned long)count,
+		    (unsigned long)size);
+		abort();
+	}
+
+	return result;
+}
+
+static void
+arena_reset(struct arena *arena)
+{
+	assert(arena->temp_count == 0);
+	arena->used = 0;
+}
+
+static struct arena_temp
+arena_begin_temp(struct arena *arena)
+{
+	struct arena_temp result;
+	result.arena = arena;
+	result.used = arena->used;
+	result.temp_count = ++arena->temp_count;
+	return result;
+}
+
+static void
+arena_end_temp(struct arena_temp temp)
+{
+	struct arena *arena = temp.arena;
+	assert(arena->temp_count == temp.temp_count);
+	assert(arena->used >= temp.used);
+	arena->used = temp.used;
+	arena->temp_count--;
+}
+
+static struct arena
+arena_create(usz size, struct arena *arena)
+{
+	void *data = alloc(arena, 1, size, _Alignof(max_align_t));
+	return arena_init(data, size);
+}
+
+static struct arena_stats
+arena_get_stats(const struct arena *arena)
+{
+	struct arena_stats stats = {0};
+	stats.size = arena->reserved ? arena->reserved : arena->size;
+	stats.used = arena->used;
+	stats.peak = arena->peak;
+	stats.allocation_count = arena->allocation_count;
+	return stats;
+}
@@ -11,13 +11,47 @@ enum log_level {
 	LOG_LEVEL_COUNT
 };
 
+/*
+ * NOTE: the size of an arena is the memory that can be used right now. An
+ * arena that was reserved only commits its memory once it is used, so its
+ * size grows up to the reserved size. Arenas with a reserved size of zero
+ * never grow. The peak is the most memory that was used at once and the
+ * allocation count is the number of allocations since the arena was
+ * created. The temp count is the number of open temporary scopes.
+ */
 struct arena {
 	u8 *data;
 	usz size;
 	usz used;
+	usz reserved;
+	usz peak;
+	usz allocation_count;
+	u32 temp_count;
 };
 
-#define ALLOC(arena, count, type) ((type *)alloc(arena, count, sizeof(type)))
+// NOTE: everything that is allocated after the start of a temporary scope
+// is freed at its end. Temporary scopes can be nested, but they have to be
+// ended in the reverse order.
+struct arena_temp {
+	struct arena *arena;
+	usz used;
+	u32 temp_count;
+};
+
+// NOTE: all sizes are in bytes, the size is the reserved size for arenas
+// that grow.
+struct arena_stats {
+	usz size;
+	usz used;
+	usz peak;
+	usz allocation_count;
+};
+
+// NOTE: reserved arenas commit their memory in steps of this size
+#define ARENA_COMMIT_SIZE KB(64)
+
+#define ALLOC(arena, count, type) \
+	((type *)alloc(arena, count, sizeof(type), _Alignof(type)))
 
 #define log_info(...) log_(LOG_INFO, __FILE__, __LINE__, __func__, __VA_ARGS__)
 #define log_debug(...) log_(LOG_DEBUG, __FILE__, __LINE__, __func__, __VA_ARGS__)
@@ -5,6 +5,7 @@
 #include <waycraft/waycraft.h>
 
 #include "waycraft/util.c"
+#include "waycraft/task.c"
 #include "waycraft/compositor.c"
 #include "waycraft/x11.c"
 #include "waycraft/drm.c"
@@ -16,6 +17,10 @@ game_load(struct game_code *game)
 	if (stat(game->path, &st) != -1) {
 		if (game->ino != st.st_ino || !game->handle) {
 			if (game->handle) {
+				// NOTE: the tasks may still reference the old code
+				struct platform_api *platform = game->memory.platform;
+				platform->complete_all_tasks(platform->queue);
+
 				dlclose(game->handle);
 				game->handle = NULL;
 				game->update = NULL;
@@ -44,65 +49,6 @@ push_event(struct platform_event_array *events, u32 type)
 	return result;
 }
 
-static bool
-execute_task(struct platform_task_queue *queue)
-{
-	bool executed_task = false;
-
-	if (queue->next_read != queue->next_write) {
-		executed_task = true;
-
-		pthread_mutex_lock(&queue->lock);
-		struct platform_task task = queue->tasks[queue->next_read];
-		queue->next_read = (queue->next_read + 1) % queue->task_count;
-		pthread_mutex_unlock(&queue->lock);
-
-		assert(task.callback);
-		task.callback(task.data);
-
-		pthread_mutex_lock(&queue->lock);
-		queue->completed_task_count++;
-		pthread_mutex_unlock(&queue->lock);
-	}
-
-	return executed_task;
-}
-
-static void *
-thread_proc(void *data)
-{
-	struct platform_task_queue *queue = data;
-	sigset_t signal_set;
-	sigemptyset(&signal_set);
-	sigaddset(&signal_set, SIGUSR1);
-	pthread_sigmask(SIG_BLOCK, &signal_set, NULL);
-
-	for (;;) {
-		if (!execute_task(queue)) {
-			pthread_cond_wait(&queue->new_task, &queue->lock);
-		}
-	}
-
-	return NULL;
-}
-
-static void
-add_task(struct platform_task_queue *queue, platform_task_callback_t *callback, void *data)
-{
-	pthread_mutex_lock(&queue->lock);
-	assert(queue->next_write + 1 != queue->next_read);
-
-	struct platform_task *task = &queue->tasks[queue->next_write];
-	task->callback = callback;
-	task->data = data;
-
-	queue->next_write = (queue->next_write + 1) % queue->task_count;
-	queue->task_count++;
-
-	pthread_cond_broadcast(&queue->new_task);
-	pthread_mutex_unlock(&queue->lock);
-}
-
 static i32
 egl_init(struct egl_context *egl, EGLenum platform,
     EGLNativeDisplayType native_display, EGLNativeWindowType native_window)
@@ -187,30 +133,22 @@ main(void)
 {
 	i32 result = 0;
 
-	// NOTE: initialize the task queue and threads
+	// NOTE: initialize the task queue and threads. The game waits for the
+	// results of its tasks, so there has to be at least one worker thread.
 	struct platform_task_queue queue = {0};
-	result = pthread_mutex_init(&queue.lock, NULL);
-	assert(result == 0);
-
-	result = pthread_cond_init(&queue.new_task, NULL);
-	assert(result == 0);
-
-	pthread_attr_t attr;
-	result = pthread_attr_init(&attr);
-	assert(result == 0);
-
-	u32 processor_count = get_nprocs();
-	pthread_t *threads = calloc(processor_count, sizeof(*threads));
-	for (u32 i = 1; i < processor_count; i++) {
-		result = pthread_create(&threads[i], &attr, thread_proc, &queue);
-		assert(result == 0);
-
-		pthread_detach(threads[i]);
-	}
+	u32 thread_count = MAX(get_nprocs(), 2);
+	task_queue_init(&queue, thread_count);
 
 	struct opengl_api gl = {0};
 	struct platform_api platform = {0};
 	platform.add_task = add_task;
+	platform.add_child_task = add_child_task;
+	platform.wait_task = wait_task;
+	platform.parallel_for = parallel_for;
+	platform.complete_all_tasks = complete_all_tasks;
+	platform.set_background_quota = set_background_quota;
+	platform.get_task_stats = get_task_stats;
+	platform.get_scratch_stats = get_scratch_stats;
 	platform.queue = &queue;
 
 	// NOTE: initialize the game
@@ -25,22 +25,8 @@ struct platform_event_array {
 	u32 count;
 };
 
-struct platform_task {
-	platform_task_callback_t *callback;
-	void *data;
-};
-
-struct platform_task_queue {
-	struct platform_task tasks[256];
-	pthread_mutex_t lock;
-	pthread_cond_t new_task;
-	u32 completed_task_count;
-	u32 task_count;
-	u32 next_read;
-	u32 next_write;
-};
-
 static void game_load(struct game_code *game);
+static void complete_all_tasks(struct platform_task_queue *queue);
 static i32 egl_init(struct egl_context *egl, EGLenum platform,
     EGLNativeDisplayType native_display, EGLNativeWindowType native_window);
 static void egl_finish(struct egl_context *egl);
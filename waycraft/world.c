@@ -1,3 +1,17 @@
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define WORLD_SSE2 1
+#endif
+
+static_assert(CHUNK_TABLE_SIZE >= 2 * MAX_CHUNK_COUNT,
+    "The chunk table must not be more than half full");
+static_assert(COLUMN_TABLE_SIZE >= 2 * MAX_COLUMN_COUNT,
+    "The column table must not be more than half full");
+static_assert((UNLOADED_TABLE_SIZE & (UNLOADED_TABLE_SIZE - 1)) == 0,
+    "The unloaded chunk table size must be a power of two");
+static_assert(BLOCK_WINDOW < CHUNK_PALETTE_SIZE,
+    "The chunk palette must be able to hold every block type");
+
 static inline u32
 block_index(u32 x, u32 y, u32 z)
 {
@@ -8,29 +22,15 @@ block_index(u32 x, u32 y, u32 z)
 	return (z * BLOCK_COUNT_Y + y) * BLOCK_COUNT_X + x;
 }
 
+// NOTE: a border is indexed by the two axes that are not its normal, in the
+// order of the axes.
 static inline u32
-chunk_index_pack(v3i coord)
-{
-	u32 index = (coord.z * CHUNK_COUNT_Y + coord.y) * CHUNK_COUNT_X + coord.x;
-
-	assert(0 <= coord.x && coord.x < CHUNK_COUNT_X);
-	assert(0 <= coord.y && coord.y < CHUNK_COUNT_Y);
-	assert(0 <= coord.z && coord.z < CHUNK_COUNT_Z);
-
-	return index;
-}
-
-static inline v3i
-chunk_index_unpack(u32 index)
+border_index(u32 a, u32 b)
 {
-	assert(index < CHUNK_COUNT);
+	assert(a < BLOCK_COUNT_X);
+	assert(b < BLOCK_COUNT_X);
 
-	v3i result;
-	result.x = index % CHUNK_COUNT_X;
-	result.y = index / CHUNK_COUNT_X % CHUNK_COUNT_Y;
-	result.z = index / CHUNK_COUNT_X / CHUNK_COUNT_Y;
-
-	return result;
+	return b * BLOCK_COUNT_X + a;
 }
 
 static inline v3
@@ -49,6 +49,75 @@ normalize_height(f32 value)
 	return 2.f * value;
 }
 
+static inline u32
+chunk_size_class(u32 bits_per_block)
+{
+	u32 size_class = 0;
+	while ((1u << size_class) < bits_per_block) {
+		size_class++;
+	}
+
+	assert(size_class < CHUNK_SIZE_CLASS_COUNT);
+	return size_class;
+}
+
+static inline usize
+chunk_indices_size(u32 bits_per_block)
+{
+	return BLOCK_COUNT * bits_per_block / 8;
+}
+
+// NOTE: returns zero if there is no memory left in the arena
+static u32 *
+world_alloc_indices(struct world *world, u32 bits_per_block)
+{
+	u32 *result = 0;
+
+	u32 size_class = chunk_size_class(bits_per_block);
+	usize size = chunk_indices_size(bits_per_block);
+	if (world->free_indices[size_class]) {
+		result = world->free_indices[size_class];
+		world->free_indices[size_class] = *(u32 **)result;
+	} else {
+		// NOTE: free index storage contains a pointer, so it has to be
+		// aligned like one.
+		result = arena_alloc(world->arena, size, _Alignof(u32 *));
+		if (result) {
+			world->block_memory += size;
+		}
+	}
+
+	if (result) {
+		world->used_block_memory += size;
+	}
+
+	return result;
+}
+
+static void
+world_free_indices(struct world *world, u32 *indices, u32 bits_per_block)
+{
+	u32 size_class = chunk_size_class(bits_per_block);
+	*(u32 **)indices = world->free_indices[size_class];
+	world->free_indices[size_class] = indices;
+	world->used_block_memory -= chunk_indices_size(bits_per_block);
+}
+
+static inline u32
+chunk_get_index(const struct chunk *chunk, u32 i)
+{
+	u32 result = 0;
+
+	u32 bits_per_block = chunk->bits_per_block;
+	if (bits_per_block != 0) {
+		u32 bit = i * bits_per_block;
+		u32 mask = (1u << bits_per_block) - 1;
+		result = (chunk->indices[bit / 32] >> (bit % 32)) & mask;
+	}
+
+	return result;
+}
+
 static u32
 chunk_at(const struct chunk *chunk, i32 x, i32 y, i32 z)
 {
@@ -56,507 +125,2646 @@ chunk_at(const struct chunk *chunk, i32 x, i32 y, i32 z)
 	u32 is_inside_chunk = (0 <= x && x < BLOCK_COUNT_X)
 	    && (0 <= y && y < BLOCK_COUNT_Y)
 	    && (0 <= z && z < BLOCK_COUNT_Z);
-	if (is_inside_chunk) {
+	// NOTE: chunks that were not generated yet only contain air
+	if (!is_inside_chunk || chunk->palette_count == 0) {
+		result = BLOCK_AIR;
+	} else if (chunk->bits_per_block == 0) {
+		result = chunk->palette[0];
+	} else {
 		u32 index = (z * BLOCK_COUNT_Y + y) * BLOCK_COUNT_X + x;
 
-		result = chunk->blocks[index];
+		result = chunk->palette[chunk_get_index(chunk, index)];
 	}
 
 	return result;
 }
 
-// NOTE: may generate chunk if it has not been initialized
-static struct chunk *
-world_get_chunk(struct world *world, f32 x, f32 y, f32 z)
+// NOTE: decodes the blocks of the chunk one word at a time
+static void
+chunk_unpack(const struct chunk *chunk, u16 *blocks)
 {
-	struct chunk *result = 0;
-
-	v3i chunk_coord = {0};
-	chunk_coord.x = floor(x / BLOCK_COUNT_X);
-	chunk_coord.y = floor(y / BLOCK_COUNT_Y);
-	chunk_coord.z = floor(z / BLOCK_COUNT_Z);
+	if (chunk->bits_per_block == 0) {
+		u16 block = chunk->palette[0];
+		for (u32 i = 0; i < BLOCK_COUNT; i++) {
+			blocks[i] = block;
+		}
 
-	v3i chunk_rel_coord = chunk_coord;
-	chunk_rel_coord.x %= CHUNK_COUNT_X;
-	if (chunk_rel_coord.x < 0) {
-		chunk_rel_coord.x += CHUNK_COUNT_X;
+		return;
 	}
 
-	chunk_rel_coord.y %= CHUNK_COUNT_Y;
-	if (chunk_rel_coord.y < 0) {
-		chunk_rel_coord.y += CHUNK_COUNT_Y;
+	u32 bits_per_block = chunk->bits_per_block;
+	u32 blocks_per_word = 32 / bits_per_block;
+	u32 mask = (1u << bits_per_block) - 1;
+	const u32 *indices = chunk->indices;
+	const u8 *palette = chunk->palette;
+
+	for (u32 i = 0; i < BLOCK_COUNT; i += blocks_per_word) {
+		u32 word = *indices++;
+		for (u32 j = 0; j < blocks_per_word; j++) {
+			*blocks++ = palette[word & mask];
+			word >>= bits_per_block;
+		}
 	}
+}
 
-	chunk_rel_coord.z %= CHUNK_COUNT_Z;
-	if (chunk_rel_coord.z < 0) {
-		chunk_rel_coord.z += CHUNK_COUNT_Z;
+// NOTE: uniform chunks only store a single block in their palette and
+// don't need any storage for the indices.
+static void
+chunk_set_uniform(struct world *world, struct chunk *chunk, enum block_type block)
+{
+	if (chunk->indices) {
+		world_free_indices(world, chunk->indices, chunk->bits_per_block);
 	}
 
-	assert(0 <= chunk_rel_coord.x && chunk_rel_coord.x < CHUNK_COUNT_X);
-	assert(0 <= chunk_rel_coord.y && chunk_rel_coord.y < CHUNK_COUNT_Y);
-	assert(0 <= chunk_rel_coord.z && chunk_rel_coord.z < CHUNK_COUNT_Z);
+	chunk->indices = 0;
+	chunk->bits_per_block = 0;
+	chunk->palette_count = 1;
+	chunk->palette[0] = block;
+}
+
+// NOTE: replaces the blocks of the chunk, returns zero if there was no
+// memory left for the chunk.
+static u32
+chunk_pack(struct world *world, struct chunk *chunk, const u16 *blocks)
+{
+	u8 palette_index[CHUNK_PALETTE_SIZE];
+	memset(palette_index, 0xff, sizeof(palette_index));
 
-	u32 chunk_index = chunk_index_pack(chunk_rel_coord);
-	struct chunk *chunk = &world->chunks[chunk_index];
-	if (v3i_equals(chunk->coord, chunk_coord)) {
-		result = chunk;
+	u8 palette[CHUNK_PALETTE_SIZE];
+	u32 palette_count = 0;
+	for (u32 i = 0; i < BLOCK_COUNT; i++) {
+		u32 block = blocks[i];
+		assert(block < CHUNK_PALETTE_SIZE);
+
+		if (palette_index[block] == 0xff) {
+			palette_index[block] = palette_count;
+			palette[palette_count++] = block;
+		}
 	}
 
-	return result;
-}
+	if (palette_count == 1) {
+		chunk_set_uniform(world, chunk, palette[0]);
+		return 1;
+	}
 
-static v3
-world_get_block_pos(const struct world *world, f32 x, f32 y, f32 z)
-{
-	v3 result = {0};
+	u32 bits_per_block = 1;
+	while ((1u << bits_per_block) < palette_count) {
+		bits_per_block *= 2;
+	}
 
-	result.x = fmodf(x, BLOCK_COUNT_X);
-	if (result.x < 0) {
-		result.x += BLOCK_COUNT_X;
+	u32 *indices = world_alloc_indices(world, bits_per_block);
+	if (!indices) {
+		return 0;
 	}
 
-	result.y = fmodf(y, BLOCK_COUNT_Y);
-	if (result.y < 0) {
-		result.y += BLOCK_COUNT_Y;
+	u32 blocks_per_word = 32 / bits_per_block;
+	u32 *out = indices;
+	for (u32 i = 0; i < BLOCK_COUNT; i += blocks_per_word) {
+		u32 word = 0;
+		for (u32 j = 0; j < blocks_per_word; j++) {
+			word |= (u32)palette_index[*blocks++] << (j * bits_per_block);
+		}
+
+		*out++ = word;
 	}
 
-	result.z = fmodf(z, BLOCK_COUNT_Z);
-	if (result.z < 0) {
-		result.z += BLOCK_COUNT_Z;
+	if (chunk->indices) {
+		world_free_indices(world, chunk->indices, chunk->bits_per_block);
 	}
 
-	return result;
+	chunk->indices = indices;
+	chunk->bits_per_block = bits_per_block;
+	chunk->palette_count = palette_count;
+	memcpy(chunk->palette, palette, palette_count);
+	return 1;
 }
 
+// NOTE: moves the indices of the chunk into storage with more bits per block,
+// this is also how uniform chunks get their first array of indices.
 static u32
-world_at(struct world *world, f32 x, f32 y, f32 z)
+chunk_widen(struct world *world, struct chunk *chunk, u32 bits_per_block)
 {
-	u32 result = 0;
-
-	struct chunk *chunk = world_get_chunk(world, x, y, z);
+	u32 *indices = world_alloc_indices(world, bits_per_block);
+	if (!indices) {
+		return 0;
+	}
 
-	if (chunk) {
-		v3 block_pos = world_get_block_pos(world, x, y, z);
+	u32 blocks_per_word = 32 / bits_per_block;
+	u32 *out = indices;
+	for (u32 i = 0; i < BLOCK_COUNT; i += blocks_per_word) {
+		u32 word = 0;
+		for (u32 j = 0; j < blocks_per_word; j++) {
+			word |= chunk_get_index(chunk, i + j) << (j * bits_per_block);
+		}
 
-		assert(block_pos.x >= 0);
-		assert(block_pos.y >= 0);
-		assert(block_pos.z >= 0);
+		*out++ = word;
+	}
 
-		result = chunk_at(chunk, block_pos.x, block_pos.y, block_pos.z);
+	if (chunk->indices) {
+		world_free_indices(world, chunk->indices, chunk->bits_per_block);
 	}
 
-	return result;
+	chunk->indices = indices;
+	chunk->bits_per_block = bits_per_block;
+	return 1;
 }
 
-static struct world
-world_init(struct arena *arena)
+// NOTE: returns zero if the palette could not be widened
+static u32
+chunk_set_block(struct world *world, struct chunk *chunk, u32 i,
+    enum block_type block)
 {
-	struct world world = {0};
-	// NOTE: allocate memory for the chunks and blocks
-	world.chunks = ALLOC(arena, CHUNK_COUNT, struct chunk);
-	usize block_count = CHUNK_COUNT * BLOCK_COUNT;
-	u16 *blocks = ALLOC(arena, block_count, u16);
+	assert(chunk->palette_count > 0);
 
-	for (u32 i = 0; i < CHUNK_COUNT; i++) {
-		world.chunks[i].blocks = blocks + i * BLOCK_COUNT;
+	u32 palette_index = 0;
+	while (palette_index < chunk->palette_count &&
+	    chunk->palette[palette_index] != block) {
+		palette_index++;
 	}
 
-	return world;
+	if (palette_index == chunk->palette_count) {
+		u32 bits_per_block = chunk->bits_per_block;
+		u32 next_bits_per_block = bits_per_block ? 2 * bits_per_block : 1;
+		if (palette_index == (1u << bits_per_block) &&
+		    !chunk_widen(world, chunk, next_bits_per_block)) {
+			return 0;
+		}
+
+		chunk->palette[chunk->palette_count++] = block;
+	}
+
+	u32 bit = i * chunk->bits_per_block;
+	u32 mask = (1u << chunk->bits_per_block) - 1;
+	u32 *word = &chunk->indices[bit / 32];
+	*word = (*word & ~(mask << (bit % 32))) | (palette_index << (bit % 32));
+	return 1;
 }
 
-static void
-world_load_chunk(struct world *world, struct chunk *chunk,
-    struct render_cmdbuf *mesh, struct renderer *renderer)
+static struct chunk *world_lookup_chunk(struct world *world, v3i coord);
+
+/*
+ * NOTE: a uniform chunk has no visible faces if it only contains air or if
+ * all of its neighbours are uniform and cover every face of the chunk.
+ */
+static u32
+chunk_is_hidden(struct world *world, struct chunk *chunk)
 {
-	struct game_assets *assets = mesh->assets;
+	if (chunk->bits_per_block != 0) {
+		return 0;
+	}
+
+	u32 block = chunk->palette[0];
+	if (block == BLOCK_AIR) {
+		return 1;
+	}
 
-	v3 chunk_pos = chunk_get_pos(chunk);
-	u16 *blocks = chunk->blocks;
-	if (chunk->state == CHUNK_UNLOADED) {
-		/*
-		 * NOTE: terrain generation
-		 */
+	u32 (*is_empty)(enum block_type block) = block_is_empty;
+	if (block == BLOCK_WATER) {
+		is_empty = block_is_not_water;
+	}
 
-		f32 noise_size = 0.02f;
-		f32 low_noise_size = 0.0005f;
+	for (u32 i = 0; i < 6; i++) {
+		i32 sign = i & 1 ? -1 : 1;
+		v3i offset = v3i(sign * (i / 2 == 0), sign * (i / 2 == 1), sign * (i / 2 == 2));
+		struct chunk *neighbor = world_lookup_chunk(world, add(chunk->coord, offset));
+		if (!neighbor || neighbor->palette_count == 0 ||
+		    neighbor->bits_per_block != 0 || is_empty(neighbor->palette[0])) {
+			return 0;
+		}
+	}
 
-		i32 height[BLOCK_COUNT_X][BLOCK_COUNT_Z];
-		for (i32 z = 0; z < BLOCK_COUNT_Z; z++) {
-			for (i32 x = 0; x < BLOCK_COUNT_X; x++) {
-				v3 point = {0};
-				point.x = chunk_pos.x + x;
-				point.z = chunk_pos.z + z;
-
-				v3 high_point = mulf(point, noise_size);
-				v3 low_point = mulf(point, low_noise_size);
-				f32 value = 2.0f * perlin_noise_layered(high_point, 8, 0.5f) - 1.0f;
-				f32 low_value = 2.0f * perlin_noise_layered(low_point, 8, 0.8f) - 1.0f;
-				height[x][z] = 8.0f * (value + 0.2f) * (2.0f * low_value + 0.3f) * BLOCK_COUNT_X - chunk_pos.y;
-
-				i32 stone_max = CLAMP(height[x][z] - 3, 0, BLOCK_COUNT_Y);
-				i32 dirt_max = CLAMP(height[x][z] - 1, 0, BLOCK_COUNT_Y);
-				i32 grass_max = CLAMP(height[x][z], 0, BLOCK_COUNT_Y);
-
-				i32 y = 0;
-				while (y < stone_max) {
-					u32 i = block_index(x, y++, z);
-					blocks[i] = BLOCK_STONE;
-				}
+	return 1;
+}
 
-				while (y < dirt_max) {
-					f32 world_y = chunk_pos.y + y;
-					u32 i = block_index(x, y++, z);
-					blocks[i] = world_y < 2 ? BLOCK_SAND : BLOCK_DIRT;
-				}
+static u32
+chunk_hash(v3i coord)
+{
+	u32 hash = coord.x * 73856093u ^ coord.y * 19349663u ^ coord.z * 83492791u;
+	hash ^= hash >> 16;
+	hash *= 0x7feb352du;
+	hash ^= hash >> 15;
 
-				while (y < grass_max) {
-					f32 world_y = chunk_pos.y + y;
-					u32 i = block_index(x, y++, z);
-					blocks[i] = world_y < 2 ? BLOCK_SAND : BLOCK_GRASS;
-				}
+	return hash;
+}
 
-				enum block_type filler = BLOCK_AIR;
-				if (chunk_pos.y < 0) {
-					filler = BLOCK_WATER;
-				}
+static u32
+world_find_chunk_slot(const struct world *world, v3i coord)
+{
+	u32 mask = world->chunk_table_size - 1;
+	u32 slot = chunk_hash(coord) & mask;
 
-				while (y < BLOCK_COUNT_Y) {
-					u32 i = block_index(x, y++, z);
-					blocks[i] = filler;
-				}
-			}
+	for (;;) {
+		u32 index = world->chunk_table[slot];
+		if (index == 0 || v3i_equals(world->chunks[index - 1].coord, coord)) {
+			break;
 		}
 
-		/*
-		 * NOTE: tree generation
-		 */
+		slot = (slot + 1) & mask;
+	}
 
-		v3i coord = chunk->coord;
-		coord.y = 0;
-#if 1
-		u32 seed = djb2(&coord, sizeof(coord));
-#else
-		coord.x *= 0x328401efa;
-		coord.z ^= coord.x << 16 | coord.x >> 16;
-		coord.z *= 0x3820afb8d;
-		coord.x ^= coord.z << 16 | coord.z >> 16;
-		coord.x *= 0x328401efa;
-		u32 seed = coord.x;
-#endif
+	return slot;
+}
 
-		f32 tree_noise_size = 100.f;
-		v3 density_point = mulf(chunk_pos, tree_noise_size);
-		density_point.y = 0;
-
-		f32 density = 9.f * perlin_noise(density_point) - 2.f;
-		u32 tree_count = CLAMP(density, 0, 7);
-		for (u32 i = 0; i < tree_count; i++) {
-			u32 x = xorshift32(&seed) % BLOCK_COUNT_X;
-			u32 z = xorshift32(&seed) % BLOCK_COUNT_Z;
-			u32 tree_height = (xorshift32(&seed) & 7) + 2;
-
-			if (height[x][z] + chunk_pos.y > 2) {
-				for (i32 y = height[x][z]; y < BLOCK_COUNT_Y && 2 <= y &&
-				    y < height[x][z] + tree_height; y++) {
-					u32 i = block_index(x, y, z);
-					blocks[i] = BLOCK_OAK_LOG;
-				}
-			}
-		}
+static struct chunk *
+world_lookup_chunk(struct world *world, v3i coord)
+{
+	struct chunk *result = 0;
+
+	u32 index = world->chunk_table[world_find_chunk_slot(world, coord)];
+	if (index != 0) {
+		result = &world->chunks[index - 1];
 	}
 
-	/*
-	 * NOTE: mesh generation
-	 */
+	return result;
+}
 
-	// TODO: fix bug for top faces
-	u16 blocks_empty[BLOCK_COUNT] = {0};
-
-#if 0
-	struct chunk *chunk_first = world->chunks;
-	struct chunk *chunk_last = world->chunks + CHUNK_COUNT;
-
-	struct chunk *chunk_right  = chunk + 1;
-	struct chunk *chunk_left   = chunk - 1;
-	struct chunk *chunk_top    = chunk + CHUNK_COUNT_X;
-	struct chunk *chunk_bottom = chunk - CHUNK_COUNT_X;
-	struct chunk *chunk_front  = chunk + CHUNK_COUNT_X * CHUNK_COUNT_Y;
-	struct chunk *chunk_back   = chunk - CHUNK_COUNT_X * CHUNK_COUNT_Y;
-#endif
+static struct chunk *
+world_lookup_adjacent(struct world *world, v3i coord, enum chunk_border border)
+{
+	v3i offset = {0};
+	offset.e[border / 2] = border & 1 ? -1 : 1;
 
-	u16 *blocks_right  = blocks_empty;
-	u16 *blocks_left   = blocks_empty;
-	u16 *blocks_top    = blocks_empty;
-	u16 *blocks_bottom = blocks_empty;
-	u16 *blocks_front  = blocks_empty;
-	u16 *blocks_back   = blocks_empty;
+	struct chunk *result = world_lookup_chunk(world, add(coord, offset));
+	return result;
+}
 
-#if 0
-	if (chunk_right < chunk_last && chunk_right->coord.x > chunk->coord.x) {
-		blocks_right = chunk_right->blocks;
+// NOTE: returns the neighbour of a chunk if it was generated
+static struct chunk *
+world_lookup_neighbor(struct world *world, v3i coord, enum chunk_border border)
+{
+	struct chunk *neighbor = world_lookup_adjacent(world, coord, border);
+	if (neighbor && neighbor->palette_count == 0) {
+		neighbor = 0;
 	}
 
-	if (chunk_left >= chunk_first && chunk_left->coord.x < chunk->coord.x) {
-		blocks_left = chunk_left->blocks;
-	}
+	return neighbor;
+}
 
-	if (chunk_top < chunk_last && chunk_top->coord.y > chunk->coord.y) {
-		blocks_top = chunk_top->blocks;
+// NOTE: neighbours that are outside of the view distance are not pending,
+// since they won't be generated until the player moves.
+static bool
+world_has_pending_neighbors(struct world *world, v3i coord)
+{
+	for (u32 i = 0; i < CHUNK_BORDER_COUNT; i++) {
+		struct chunk *neighbor = world_lookup_adjacent(world, coord, i);
+		if (neighbor && neighbor->palette_count == 0) {
+			return true;
+		}
 	}
 
-	if (chunk_bottom >= chunk_first && chunk_bottom->coord.y < chunk->coord.y) {
-		blocks_bottom = chunk_bottom->blocks;
-	}
+	return false;
+}
 
-	if (chunk_front < chunk_last && chunk_front->coord.z > chunk->coord.z) {
-		blocks_front = chunk_front->blocks;
-	}
+static u32
+world_find_column_slot(const struct world *world, v3i coord)
+{
+	u32 mask = world->column_table_size - 1;
+	u32 slot = chunk_hash(coord) & mask;
+
+	for (;;) {
+		u32 index = world->column_table[slot];
+		if (index == 0 || v3i_equals(world->columns[index - 1].coord, coord)) {
+			break;
+		}
 
-	if (chunk_back >= chunk_first && chunk_back->coord.z < chunk->coord.z) {
-		blocks_back = chunk_back->blocks;
+		slot = (slot + 1) & mask;
 	}
-#endif
 
-	struct texture_id texture = get_texture(assets, TEXTURE_BLOCK_ATLAS).id;
-	assert(blocks);
+	return slot;
+}
 
-	for (u32 i = 0; i < BLOCK_COUNT; i++) {
-		u32 block = blocks[i];
-		if (block == BLOCK_AIR) {
-			continue;
-		}
+static struct chunk_column *
+world_lookup_column(struct world *world, v3i chunk_coord)
+{
+	struct chunk_column *result = 0;
 
-		i32 x = i % BLOCK_COUNT_X;
-		i32 y = i / BLOCK_COUNT_X % BLOCK_COUNT_Y;
-		i32 z = i / BLOCK_COUNT_X / BLOCK_COUNT_Y % BLOCK_COUNT_Z;
+	v3i coord = v3i(chunk_coord.x, 0, chunk_coord.z);
+	u32 index = world->column_table[world_find_column_slot(world, coord)];
+	if (index != 0) {
+		result = &world->columns[index - 1];
+	}
 
-		v3 pos[8];
-		v2 uv[4];
+	return result;
+}
 
-		pos[0] = v3_add(chunk_pos, v3(x + 0.5, y + 0.5, z + 0.5));
-		pos[1] = v3_add(chunk_pos, v3(x - 0.5, y + 0.5, z + 0.5));
-		pos[2] = v3_add(chunk_pos, v3(x + 0.5, y - 0.5, z + 0.5));
-		pos[3] = v3_add(chunk_pos, v3(x - 0.5, y - 0.5, z + 0.5));
+static void
+world_acquire_column(struct world *world, v3i chunk_coord)
+{
+	v3i coord = v3i(chunk_coord.x, 0, chunk_coord.z);
+	u32 slot = world_find_column_slot(world, coord);
+	if (world->column_table[slot] == 0) {
+		assert(world->column_count < MAX_COLUMN_COUNT);
+
+		struct chunk_column *column = &world->columns[world->column_count];
+		world->column_table[slot] = ++world->column_count;
+		column->coord = coord;
+		column->chunk_count = 0;
+		column->has_heights = 0;
+	}
 
-		pos[4] = v3_add(chunk_pos, v3(x + 0.5, y + 0.5, z - 0.5));
-		pos[5] = v3_add(chunk_pos, v3(x - 0.5, y + 0.5, z - 0.5));
-		pos[6] = v3_add(chunk_pos, v3(x + 0.5, y - 0.5, z - 0.5));
-		pos[7] = v3_add(chunk_pos, v3(x - 0.5, y - 0.5, z - 0.5));
+	struct chunk_column *column = &world->columns[world->column_table[slot] - 1];
+	column->chunk_count++;
+}
 
-		u32 (*is_empty)(enum block_type block) = block_is_empty;
+static void
+world_release_column(struct world *world, v3i chunk_coord)
+{
+	u32 *table = world->column_table;
+	u32 mask = world->column_table_size - 1;
 
-		u16 block_right = x + 1 >= BLOCK_COUNT_X ?
-		    blocks_right[block_index(x + 1 - BLOCK_COUNT_X, y, z)] :
-		    blocks[block_index(x + 1, y, z)];
+	v3i coord = v3i(chunk_coord.x, 0, chunk_coord.z);
+	u32 slot = world_find_column_slot(world, coord);
+	assert(table[slot] != 0);
 
-		u16 block_left = x - 1 < 0 ?
-		    blocks_left[block_index(x - 1 + BLOCK_COUNT_X, y, z)] :
-		    blocks[block_index(x - 1, y, z)];
+	struct chunk_column *column = &world->columns[table[slot] - 1];
+	assert(column->chunk_count > 0);
+	if (--column->chunk_count > 0) {
+		return;
+	}
 
-		u16 block_top = y + 1 >= BLOCK_COUNT_Y ?
-		    blocks_top[block_index(x, y + 1 - BLOCK_COUNT_Y, z)] :
-		    blocks[block_index(x, y + 1, z)];
+	table[slot] = 0;
 
-		u16 block_bottom = y - 1 < 0 ?
-		    blocks_bottom[block_index(x, y - 1 + BLOCK_COUNT_Y, z)] :
-		    blocks[block_index(x, y - 1, z)];
+	u32 next = (slot + 1) & mask;
+	while (table[next] != 0) {
+		v3i next_coord = world->columns[table[next] - 1].coord;
+		u32 home = chunk_hash(next_coord) & mask;
+		if (((next - home) & mask) >= ((next - slot) & mask)) {
+			table[slot] = table[next];
+			table[next] = 0;
+			slot = next;
+		}
 
-		u16 block_front = z + 1 >= BLOCK_COUNT_Z ?
-		    blocks_front[block_index(x, y, z + 1 - BLOCK_COUNT_Z)] :
-		    blocks[block_index(x, y, z + 1)];
+		next = (next + 1) & mask;
+	}
 
-		u16 block_back = z - 1 < 0 ?
-		    blocks_back[block_index(x, y, z - 1 + BLOCK_COUNT_Z)] :
-		    blocks[block_index(x, y, z - 1)];
+	struct chunk_column *last = &world->columns[--world->column_count];
+	if (column != last) {
+		*column = *last;
 
-		if (block == BLOCK_WATER) {
-			is_empty = block_is_not_water;
+		slot = world_find_column_slot(world, column->coord);
+		table[slot] = column - world->columns + 1;
+	}
+}
 
-			if (block_top == BLOCK_AIR) {
-				f32 offset = 0.1f;
+/*
+ * NOTE: computes the terrain heights of the column. The minimum and maximum
+ * height can be used to tell if a chunk is completely above or below the
+ * surface. The heights only depend on the coordinate of the column, so that
+ * they can be computed on any thread.
+ */
+static void
+column_compute_heights(struct chunk_column *column)
+{
+	v3i chunk_coord = column->coord;
+	f32 noise_size = 0.02f;
+	f32 low_noise_size = 0.0005f;
+
+	f32 min_height = F32_INF;
+	f32 max_height = -F32_INF;
+	static_assert(BLOCK_COUNT_X % 8 == 0, "Rows must be a multiple of the noise batch size");
+	for (i32 z = 0; z < BLOCK_COUNT_Z; z++) {
+		for (i32 x0 = 0; x0 < BLOCK_COUNT_X; x0 += 8) {
+			v3 high_points[8];
+			v3 low_points[8];
+			for (i32 i = 0; i < 8; i++) {
+				v3 point = {0};
+				point.x = chunk_coord.x * BLOCK_COUNT_X + x0 + i;
+				point.z = chunk_coord.z * BLOCK_COUNT_Z + z;
 
-				pos[0].y -= offset;
-				pos[1].y -= offset;
-				pos[4].y -= offset;
-				pos[5].y -= offset;
+				high_points[i] = mulf(point, noise_size);
+				low_points[i] = mulf(point, low_noise_size);
 			}
-		}
 
-		if (block != BLOCK_WATER && is_empty(block_right)) {
-			block_texcoords_right(block, uv);
-			render_quad(mesh, pos[4], pos[0], pos[6], pos[2],
-			    uv[0], uv[1], uv[2], uv[3], texture);
-		}
+			f32 high_values[8];
+			f32 low_values[8];
+			perlin_noise_layered_x8(high_points, 8, 0.5f, high_values);
+			perlin_noise_layered_x8(low_points, 8, 0.8f, low_values);
 
-		if (block != BLOCK_WATER && is_empty(block_left)) {
-			block_texcoords_left(block, uv);
-			render_quad(mesh, pos[1], pos[5], pos[3], pos[7],
-			    uv[0], uv[1], uv[2], uv[3], texture);
-		}
+			for (i32 i = 0; i < 8; i++) {
+				f32 value = 2.0f * high_values[i] - 1.0f;
+				f32 low_value = 2.0f * low_values[i] - 1.0f;
+				f32 height = 8.0f * (value + 0.2f) * (2.0f * low_value + 0.3f) * BLOCK_COUNT_X;
 
-		if (is_empty(block_top)) {
-			block_texcoords_top(block, uv);
-			render_quad(mesh, pos[4], pos[5], pos[0], pos[1],
-			    uv[0], uv[1], uv[2], uv[3], texture);
+				column->heights[x0 + i][z] = height;
+				min_height = MIN(min_height, height);
+				max_height = MAX(max_height, height);
+			}
 		}
+	}
 
-		if (is_empty(block_bottom)) {
-			block_texcoords_bottom(block, uv);
-			render_quad(mesh, pos[7], pos[6], pos[3], pos[2],
-			    uv[0], uv[1], uv[2], uv[3], texture);
-		}
+	column->min_height = min_height;
+	column->max_height = max_height;
+	column->has_heights = 1;
+}
 
-		if (block != BLOCK_WATER && is_empty(block_front)) {
-			block_texcoords_front(block, uv);
-			render_quad(mesh, pos[0], pos[1], pos[2], pos[3],
-			    uv[0], uv[1], uv[2], uv[3], texture);
-		}
+static struct unloaded_chunk *
+world_find_unloaded_chunk(struct world *world, v3i coord)
+{
+	u32 mask = UNLOADED_TABLE_SIZE - 1;
+	u32 slot = chunk_hash(coord) & mask;
 
-		if (block != BLOCK_WATER && is_empty(block_back)) {
-			block_texcoords_back(block, uv);
-			render_quad(mesh, pos[5], pos[4], pos[7], pos[6],
-			    uv[0], uv[1], uv[2], uv[3], texture);
+	for (;;) {
+		struct unloaded_chunk *entry = &world->unloaded_chunks[slot];
+		if (entry->window == 0 || v3i_equals(entry->coord, coord)) {
+			return entry;
 		}
+
+		slot = (slot + 1) & mask;
 	}
+}
 
-	renderer_build_command_buffer(renderer, mesh, &chunk->mesh);
-	chunk->state = CHUNK_READY;
+static bool
+world_is_recently_unloaded(const struct unloaded_chunk *entry, u32 window)
+{
+	return entry->window != 0 && entry->window + 1 >= window;
 }
 
 static void
-world_update(struct world *world, v3 player_pos, v3 player_dir,
-    struct renderer *renderer, struct render_cmdbuf *cmd_buffer,
-    struct arena *frame_arena, struct game_assets *assets)
+world_remember_unloaded_chunk(struct world *world, v3i coord)
 {
-	u32 max_vertex_count = BLOCK_COUNT * 4 * 6;
-	u32 max_index_count = BLOCK_COUNT * 6 * 6;
-	struct render_cmdbuf tmp_buffer = render_cmdbuf_init(frame_arena,
-	    KB(1), max_vertex_count, max_index_count);
-	tmp_buffer.assets = cmd_buffer->assets;
-
-	box3 player_bounds = {0};
-	v3 target = add(player_pos, mulf(player_dir, 3.0f * BLOCK_COUNT_X));
-	v3 world_size = v3(CHUNK_COUNT_X, CHUNK_COUNT_Y, CHUNK_COUNT_Z);
-	player_bounds.min = sub(target, mulf(world_size, 0.6 * BLOCK_COUNT_X));
-	player_bounds.max = add(target, mulf(world_size, 0.6 * BLOCK_COUNT_X));
+	// NOTE: the table is cleared once it is half full, so only the most
+	// recently unloaded chunks are counted when the player travels far.
+	if (world->unloaded_chunk_count >= UNLOADED_TABLE_SIZE / 2) {
+		memset(world->unloaded_chunks, 0,
+		    UNLOADED_TABLE_SIZE * sizeof(*world->unloaded_chunks));
+		world->unloaded_chunk_count = 0;
+	}
 
-	// NOTE: unload any chunks that are outside the player bounds
-	for (u32 i = 0; i < CHUNK_COUNT; i++) {
-		v3 chunk_pos = chunk_get_pos(&world->chunks[i]);
-		if (!box3_contains_point(player_bounds, chunk_pos)) {
-			world->chunks[i].state = CHUNK_UNLOADED;
-		}
+	struct unloaded_chunk *entry = world_find_unloaded_chunk(world, coord);
+	if (entry->window == 0) {
+		world->unloaded_chunk_count++;
 	}
 
-	// NOTE: load any chunks that are unloaded or dirty
-	v3i player_offset;
-	player_offset.x = floor(target.x / BLOCK_COUNT_X - CHUNK_COUNT_X / 2.0f);
-	player_offset.y = floor(target.y / BLOCK_COUNT_X - CHUNK_COUNT_Y / 2.0f);
-	player_offset.z = floor(target.z / BLOCK_COUNT_X - CHUNK_COUNT_Z / 2.0f);
+	entry->coord = coord;
+	entry->window = world->stats_window;
+}
+
+static void
+chunk_connect_all_borders(struct chunk *chunk)
+{
+	u32 all_borders = (1 << CHUNK_BORDER_COUNT) - 1;
+	memset(chunk->connections, all_borders, sizeof(chunk->connections));
+}
 
-	struct chunk *chunks_to_load[MAX_LOAD_PER_FRAME] = {0};
-	f32 distances[MAX_LOAD_PER_FRAME];
-	for (u32 i = 0; i < MAX_LOAD_PER_FRAME; i++) {
-		distances[i] = F32_INF;
-	}
+static void
+world_free_cache(struct world *world, struct chunk *chunk)
+{
+	mesh_allocator_free(&world->cache_allocator, chunk->cache_offset,
+	    chunk->cache_capacity);
+	chunk->cache_capacity = 0;
+	chunk->dirty_sections = CHUNK_ALL_SECTIONS;
+	memset(chunk->section_vertex_counts, 0, sizeof(chunk->section_vertex_counts));
+}
 
-	for (u32 i = 0; i < CHUNK_COUNT; i++) {
-		v3i chunk_offset = chunk_index_unpack(i);
-		v3i chunk_coord = add(player_offset, chunk_offset);
-		v3i chunk_rel_coord = chunk_coord;
+// NOTE: returns zero if there is no space left for another chunk
+static struct chunk *
+world_add_chunk(struct world *world, v3i coord)
+{
+	struct chunk *result = 0;
 
-		chunk_rel_coord.x %= CHUNK_COUNT_X;
-		if (chunk_rel_coord.x < 0) {
-			chunk_rel_coord.x += CHUNK_COUNT_X;
-		}
+	if (world->chunk_count < world->max_chunk_count) {
+		struct chunk *chunk = &world->chunks[world->chunk_count];
+		u32 slot = world_find_chunk_slot(world, coord);
+		assert(world->chunk_table[slot] == 0);
+
+		world->chunk_table[slot] = ++world->chunk_count;
+		world_acquire_column(world, coord);
+		chunk->coord = coord;
+		chunk->state = CHUNK_UNLOADED;
+		chunk->mesh = 0;
+		chunk->job = 0;
+		chunk->indices = 0;
+		chunk->bits_per_block = 0;
+		chunk->palette_count = 0;
+		chunk->palette[0] = BLOCK_AIR;
+		chunk->visit_frame = 0;
+		chunk->has_outdated_connections = 0;
+		chunk->lod = 0;
+		chunk->cache_offset = 0;
+		chunk->cache_capacity = 0;
+		chunk->dirty_sections = CHUNK_ALL_SECTIONS;
+		memset(chunk->section_vertex_counts, 0,
+		    sizeof(chunk->section_vertex_counts));
+		chunk_connect_all_borders(chunk);
+		result = chunk;
+	}
 
-		chunk_rel_coord.y %= CHUNK_COUNT_Y;
-		if (chunk_rel_coord.y < 0) {
-			chunk_rel_coord.y += CHUNK_COUNT_Y;
-		}
+	return result;
+}
 
-		chunk_rel_coord.z %= CHUNK_COUNT_Z;
-		if (chunk_rel_coord.z < 0) {
-			chunk_rel_coord.z += CHUNK_COUNT_Z;
+static void
+world_remove_chunk(struct world *world, struct chunk *chunk,
+    struct renderer *renderer)
+{
+	u32 *table = world->chunk_table;
+	u32 mask = world->chunk_table_size - 1;
+
+	// NOTE: remove the entry and shift the following entries back, so that
+	// no entry ends up before its home slot.
+	u32 slot = world_find_chunk_slot(world, chunk->coord);
+	assert(table[slot] == chunk - world->chunks + 1);
+	table[slot] = 0;
+
+	u32 next = (slot + 1) & mask;
+	while (table[next] != 0) {
+		v3i next_coord = world->chunks[table[next] - 1].coord;
+		u32 home = chunk_hash(next_coord) & mask;
+		if (((next - home) & mask) >= ((next - slot) & mask)) {
+			table[slot] = table[next];
+			table[next] = 0;
+			slot = next;
 		}
 
-		u32 chunk_index = chunk_index_pack(chunk_rel_coord);
-		struct chunk *chunk = &world->chunks[chunk_index];
+		next = (next + 1) & mask;
+	}
 
-		if (chunk->state != CHUNK_READY) {
-			chunk->coord = chunk_coord;
-			v3 chunk_pos = chunk_get_pos(chunk);
-			v3 chunk_half_dim = mulf(v3(BLOCK_COUNT_X, BLOCK_COUNT_Y, BLOCK_COUNT_Z), 0.5f);
-			chunk_pos = add(chunk_pos, chunk_half_dim);
+	if (chunk->indices) {
+		world_free_indices(world, chunk->indices, chunk->bits_per_block);
+		chunk->indices = 0;
+	}
 
-			// NOTE: find the farthest chunk and if it the current chunk is
-			// closer load the current chunk instead
-			f32 distance = length_sq(sub(target, chunk_pos));
-			f32 max_distance = distance;
-			u32 farthest_chunk_index = LENGTH(chunks_to_load);
-			for (u32 i = 0; i < LENGTH(chunks_to_load); i++) {
-				if (!chunks_to_load[i]) {
-					farthest_chunk_index = i;
-					break;
-				}
+	if (chunk->mesh) {
+		renderer_free_mesh(renderer, chunk->mesh);
+		chunk->mesh = 0;
+	}
 
-				if (max_distance < distances[i]) {
-					max_distance = distances[i];
-					farthest_chunk_index = i;
-				}
-			}
+	world_free_cache(world, chunk);
 
-			if (farthest_chunk_index < LENGTH(chunks_to_load)) {
-				chunks_to_load[farthest_chunk_index] = chunk;
-				distances[farthest_chunk_index] = distance;
-			}
-		}
+	if (chunk->palette_count > 0) {
+		world_remember_unloaded_chunk(world, chunk->coord);
 	}
 
-	for (u32 i = 0; i < LENGTH(chunks_to_load) && chunks_to_load[i]; i++) {
-		assert(chunks_to_load[i]->state != CHUNK_READY);
+	world_release_column(world, chunk->coord);
 
-		tmp_buffer.push_buffer_size = 0;
-		tmp_buffer.index_count = 0;
-		tmp_buffer.vertex_count = 0;
-		tmp_buffer.current_quads = 0;
-		world_load_chunk(world, chunks_to_load[i], &tmp_buffer, renderer);
-	}
+	// NOTE: a running job of the chunk is ignored once it is done
+	struct chunk *last = &world->chunks[--world->chunk_count];
+	if (chunk != last) {
+		*chunk = *last;
 
-	// NOTE: draw the loaded chunks
-	m4x4 transform = m4x4_id(1);
-	struct texture_id texture = get_texture(assets, TEXTURE_BLOCK_ATLAS).id;
-	for (u32 i = 0; i < CHUNK_COUNT; i++) {
-		if (world->chunks[i].mesh != 0) {
-			render_mesh(cmd_buffer, world->chunks[i].mesh, transform, texture);
-		}
+		slot = world_find_chunk_slot(world, chunk->coord);
+		table[slot] = chunk - world->chunks + 1;
 	}
 }
 
-static void
-world_place_block(struct world *world, f32 x, f32 y, f32 z,
-    enum block_type block_type)
+static struct chunk *
+world_get_chunk(struct world *world, f32 x, f32 y, f32 z)
 {
-	v3 point = v3(x, y, z);
-
-	struct chunk *chunk = world_get_chunk(world, x, y, z);
-	if (chunk) {
-		v3 block_pos = world_get_block_pos(world, x, y, z);
-		v3i block = v3i_vec3(v3_floor(block_pos));
+	v3i chunk_coord = {0};
+	chunk_coord.x = floor(x / BLOCK_COUNT_X);
+	chunk_coord.y = floor(y / BLOCK_COUNT_Y);
+	chunk_coord.z = floor(z / BLOCK_COUNT_Z);
 
-		u32 i = block_index(block.x, block.y, block.z);
-		chunk->blocks[i] = block_type;
-		chunk->state = CHUNK_DIRTY;
+	struct chunk *result = world_lookup_chunk(world, chunk_coord);
+	return result;
+}
 
-		for (u32 i = 0; i < 3; i++) {
-			v3 offset = v3(i == 0, i == 1, i == 2);
-			v3 next = add(point, offset);
-			struct chunk *next_chunk = world_get_chunk(world, next.x, next.y, next.z);
-			next_chunk->state = CHUNK_DIRTY;
+static v3
+world_get_block_pos(const struct world *world, f32 x, f32 y, f32 z)
+{
+	v3 result = {0};
+
+	result.x = fmodf(x, BLOCK_COUNT_X);
+	if (result.x < 0) {
+		result.x += BLOCK_COUNT_X;
+	}
+
+	result.y = fmodf(y, BLOCK_COUNT_Y);
+	if (result.y < 0) {
+		result.y += BLOCK_COUNT_Y;
+	}
+
+	result.z = fmodf(z, BLOCK_COUNT_Z);
+	if (result.z < 0) {
+		result.z += BLOCK_COUNT_Z;
+	}
+
+	return result;
+}
+
+static u32
+world_at(struct world *world, f32 x, f32 y, f32 z)
+{
+	u32 result = 0;
+
+	struct chunk *chunk = world_get_chunk(world, x, y, z);
+
+	if (chunk) {
+		v3 block_pos = world_get_block_pos(world, x, y, z);
+
+		assert(block_pos.x >= 0);
+		assert(block_pos.y >= 0);
+		assert(block_pos.z >= 0);
+
+		result = chunk_at(chunk, block_pos.x, block_pos.y, block_pos.z);
+	}
+
+	return result;
+}
+
+static struct world
+world_init(struct arena *arena, struct platform_api *platform)
+{
+	struct world world = {0};
+	world.arena = arena;
+	world.platform = platform;
+	world.view_distance = DEFAULT_VIEW_DISTANCE;
+	world.unload_distance = UNLOAD_DISTANCE(DEFAULT_VIEW_DISTANCE);
+
+	// NOTE: the blocks are only allocated once a chunk is generated
+	world.max_chunk_count = MAX_CHUNK_COUNT;
+	world.chunks = ALLOC(arena, MAX_CHUNK_COUNT, struct chunk);
+
+	u32 max_vertex_count = BLOCK_COUNT * 4 * 6;
+	world.jobs = ALLOC(arena, MAX_CHUNK_JOB_COUNT, struct chunk_job);
+	for (u32 i = 0; i < MAX_CHUNK_JOB_COUNT; i++) {
+		struct chunk_job *job = &world.jobs[i];
+		job->mesh = mesh_buffer_init(arena, max_vertex_count);
+	}
+
+	// NOTE: every free range of the cache is followed by a chunk or the end
+	// of the cache
+	struct mesh_allocator *cache_allocator = &world.cache_allocator;
+	cache_allocator->max_vertex_count = CHUNK_CACHE_SIZE / sizeof(struct mesh_vertex);
+	cache_allocator->max_free_range_count = MAX_CHUNK_COUNT + 1;
+	cache_allocator->free_ranges = ALLOC(arena,
+	    cache_allocator->max_free_range_count, struct mesh_range);
+	cache_allocator->free_ranges[0].offset = 0;
+	cache_allocator->free_ranges[0].size = cache_allocator->max_vertex_count;
+	cache_allocator->free_range_count = 1;
+	world.cache = ALLOC(arena, cache_allocator->max_vertex_count,
+	    struct mesh_vertex);
+
+	world.chunk_table_size = CHUNK_TABLE_SIZE;
+	world.chunk_table = ALLOC(arena, CHUNK_TABLE_SIZE, u32);
+	world.columns = ALLOC(arena, MAX_COLUMN_COUNT, struct chunk_column);
+	world.column_table_size = COLUMN_TABLE_SIZE;
+	world.column_table = ALLOC(arena, COLUMN_TABLE_SIZE, u32);
+	world.load_queue = ALLOC(arena, MAX_CHUNK_COUNT, struct chunk_queue_entry);
+	world.stages[CHUNK_STAGE_GENERATE].budget = DEFAULT_GENERATE_BUDGET;
+	world.stages[CHUNK_STAGE_MESH].budget = DEFAULT_MESH_BUDGET;
+	world.stages[CHUNK_STAGE_UPLOAD].budget = DEFAULT_UPLOAD_BUDGET;
+	world.mesh_mode = CHUNK_MESH_GREEDY;
+	world.mesh_distance_sq = F32_INF;
+	world.unloaded_chunks = ALLOC(arena, UNLOADED_TABLE_SIZE, struct unloaded_chunk);
+	world.cull_batches = ALLOC(arena, (MAX_CHUNK_COUNT + 3) / 4,
+	    struct chunk_cull_batch);
+	world.visit_queue = ALLOC(arena, CHUNK_BORDER_COUNT * MAX_CHUNK_COUNT,
+	    struct chunk_visit);
+	world.is_occlusion_culling_enabled = true;
+	world.is_lod_enabled = true;
+	world.stats_window = 1;
+	world.stats_window_start = get_time_sec();
+
+	return world;
+}
+
+static void
+world_set_view_distance(struct world *world, i32 view_distance)
+{
+	world->view_distance = CLAMP(view_distance, 1, MAX_VIEW_DISTANCE);
+	world->unload_distance = UNLOAD_DISTANCE(world->view_distance);
+}
+
+static void
+world_set_stage_budget(struct world *world, enum chunk_stage stage, f32 budget)
+{
+	world->stages[stage].budget = MAX(budget, 0.0f);
+}
+
+/*
+ * NOTE: generates the blocks of the chunk at the coordinate from the terrain
+ * heights of its column. Returns true if the chunk is uniform, then only the
+ * first block is set.
+ */
+static bool
+chunk_generate(const struct chunk_column *column, v3i chunk_coord, u16 *blocks)
+{
+	v3 chunk_pos = v3(chunk_coord.x * BLOCK_COUNT_X,
+	    chunk_coord.y * BLOCK_COUNT_Y, chunk_coord.z * BLOCK_COUNT_Z);
+
+	/*
+	 * NOTE: terrain generation
+	 */
+
+	i32 min_height = column->min_height - chunk_pos.y;
+	i32 max_height = column->max_height - chunk_pos.y;
+
+	enum block_type filler = BLOCK_AIR;
+	if (chunk_pos.y < 0) {
+		filler = BLOCK_WATER;
+	}
+
+	// NOTE: chunks that are completely above or below the surface only
+	// contain a single block and don't need to be filled.
+	if (max_height <= 0) {
+		blocks[0] = filler;
+		return true;
+	} else if (min_height - 3 >= BLOCK_COUNT_Y) {
+		blocks[0] = BLOCK_STONE;
+		return true;
+	}
+
+	i32 height[BLOCK_COUNT_X][BLOCK_COUNT_Z];
+	for (i32 z = 0; z < BLOCK_COUNT_Z; z++) {
+		for (i32 x = 0; x < BLOCK_COUNT_X; x++) {
+			height[x][z] = column->heights[x][z] - chunk_pos.y;
+
+			i32 stone_max = CLAMP(height[x][z] - 3, 0, BLOCK_COUNT_Y);
+			i32 dirt_max = CLAMP(height[x][z] - 1, 0, BLOCK_COUNT_Y);
+			i32 grass_max = CLAMP(height[x][z], 0, BLOCK_COUNT_Y);
+
+			i32 y = 0;
+			while (y < stone_max) {
+				u32 i = block_index(x, y++, z);
+				blocks[i] = BLOCK_STONE;
+			}
+
+			while (y < dirt_max) {
+				f32 world_y = chunk_pos.y + y;
+				u32 i = block_index(x, y++, z);
+				blocks[i] = world_y < 2 ? BLOCK_SAND : BLOCK_DIRT;
+			}
+
+			while (y < grass_max) {
+				f32 world_y = chunk_pos.y + y;
+				u32 i = block_index(x, y++, z);
+				blocks[i] = world_y < 2 ? BLOCK_SAND : BLOCK_GRASS;
+			}
+
+			while (y < BLOCK_COUNT_Y) {
+				u32 i = block_index(x, y++, z);
+				blocks[i] = filler;
+			}
+		}
+	}
+
+	/*
+	 * NOTE: tree generation
+	 */
+
+	v3i coord = chunk_coord;
+	coord.y = 0;
+#if 1
+	u32 seed = djb2(&coord, sizeof(coord));
+#else
+	coord.x *= 0x328401efa;
+	coord.z ^= coord.x << 16 | coord.x >> 16;
+	coord.z *= 0x3820afb8d;
+	coord.x ^= coord.z << 16 | coord.z >> 16;
+	coord.x *= 0x328401efa;
+	u32 seed = coord.x;
+#endif
+
+	f32 tree_noise_size = 100.f;
+	v3 density_point = mulf(chunk_pos, tree_noise_size);
+	density_point.y = 0;
+
+	f32 density = 9.f * perlin_noise(density_point) - 2.f;
+	u32 tree_count = CLAMP(density, 0, 7);
+	for (u32 i = 0; i < tree_count; i++) {
+		u32 x = xorshift32(&seed) % BLOCK_COUNT_X;
+		u32 z = xorshift32(&seed) % BLOCK_COUNT_Z;
+		u32 tree_height = (xorshift32(&seed) & 7) + 2;
+
+		if (height[x][z] + chunk_pos.y > 2) {
+			for (i32 y = height[x][z]; y < BLOCK_COUNT_Y && 2 <= y &&
+			    y < height[x][z] + tree_height; y++) {
+				u32 i = block_index(x, y, z);
+				blocks[i] = BLOCK_OAK_LOG;
+			}
+		}
+	}
+
+	return false;
+}
+
+/*
+ * NOTE: the faces are in the same order as the borders. The axes and
+ * directions of the faces match the corners of the faces in chunk_mesh, the
+ * texture of a face starts at its first corner.
+ */
+static const struct {
+	u8 normal, u, v;
+	i8 normal_dir, u_dir, v_dir;
+	void (*texcoords)(enum block_type block, v2 *uv);
+} chunk_faces[CHUNK_BORDER_COUNT] = {
+	{ 0, 2, 1, +1, +1, -1, block_texcoords_right  },
+	{ 0, 2, 1, -1, -1, -1, block_texcoords_left   },
+	{ 1, 0, 2, +1, -1, +1, block_texcoords_top    },
+	{ 1, 0, 2, -1, +1, +1, block_texcoords_bottom },
+	{ 2, 0, 1, +1, -1, -1, block_texcoords_front  },
+	{ 2, 0, 1, -1, +1, -1, block_texcoords_back   },
+};
+
+// NOTE: returns the tile of the block atlas for a face of the block
+static u32
+chunk_face_tile(u32 face, u32 block)
+{
+	v2 uv[4];
+	chunk_faces[face].texcoords(block, uv);
+
+	u32 tile_x = uv[0].x * 16 + 0.5f;
+	u32 tile_y = uv[0].y * 16 + 0.5f;
+	return tile_x + 16 * tile_y;
+}
+
+// NOTE: returns the masks of the solid and the water blocks in a row
+static void
+chunk_classify_row(const u16 *row, u32 *solid, u32 *water)
+{
+	static_assert(BLOCK_COUNT_X == 16, "A row must fit into two SSE registers");
+
+#if WORLD_SSE2
+	__m128i lo = _mm_loadu_si128((const __m128i *)row);
+	__m128i hi = _mm_loadu_si128((const __m128i *)(row + 8));
+	__m128i air = _mm_set1_epi16(BLOCK_AIR);
+	__m128i water_block = _mm_set1_epi16(BLOCK_WATER);
+
+	u32 air_mask = _mm_movemask_epi8(_mm_packs_epi16(
+	    _mm_cmpeq_epi16(lo, air), _mm_cmpeq_epi16(hi, air)));
+	u32 water_mask = _mm_movemask_epi8(_mm_packs_epi16(
+	    _mm_cmpeq_epi16(lo, water_block), _mm_cmpeq_epi16(hi, water_block)));
+#else
+	u32 air_mask = 0;
+	u32 water_mask = 0;
+	for (u32 x = 0; x < BLOCK_COUNT_X; x++) {
+		air_mask |= (row[x] == BLOCK_AIR) << x;
+		water_mask |= (row[x] == BLOCK_WATER) << x;
+	}
+#endif
+
+	*solid = ~(air_mask | water_mask) & 0xffff;
+	*water = water_mask;
+}
+
+/*
+ * NOTE: finds the visible faces of a section of a chunk. The blocks of each
+ * row along the x axis are classified into masks of solid and water blocks
+ * with one bit per block. The faces of a row are then culled against the
+ * rows next to it at once. Along the x axis, the row is extended by the
+ * blocks of the borders on both sides and culled against itself.
+ */
+static void
+chunk_cull_faces(const u16 *blocks, u16 (*borders)[CHUNK_BORDER_SIZE],
+    u32 section, struct chunk_face_masks *masks)
+{
+	// NOTE: the masks also contain the rows around the section, the rows
+	// that are outside of the chunk along both y and z are never used.
+	u32 solid[BLOCK_COUNT_Z + 2][CHUNK_SECTION_HEIGHT + 2];
+	u32 water[BLOCK_COUNT_Z + 2][CHUNK_SECTION_HEIGHT + 2];
+	i32 start_y = section * CHUNK_SECTION_HEIGHT;
+	masks->hidden_border_count = 0;
+
+	for (i32 z = -1; z <= BLOCK_COUNT_Z; z++) {
+		for (i32 y = start_y - 1; y <= start_y + CHUNK_SECTION_HEIGHT; y++) {
+			bool is_outside_y = y < 0 || y >= BLOCK_COUNT_Y;
+			bool is_outside_z = z < 0 || z >= BLOCK_COUNT_Z;
+			if (is_outside_y && is_outside_z) {
+				continue;
+			}
+
+			const u16 *row;
+			if (y < 0) {
+				row = &borders[CHUNK_BORDER_BOTTOM][border_index(0, z)];
+			} else if (y >= BLOCK_COUNT_Y) {
+				row = &borders[CHUNK_BORDER_TOP][border_index(0, z)];
+			} else if (z < 0) {
+				row = &borders[CHUNK_BORDER_BACK][border_index(0, y)];
+			} else if (z >= BLOCK_COUNT_Z) {
+				row = &borders[CHUNK_BORDER_FRONT][border_index(0, y)];
+			} else {
+				row = &blocks[block_index(0, y, z)];
+			}
+
+			u32 i = z + 1, j = y - start_y + 1;
+			chunk_classify_row(row, &solid[i][j], &water[i][j]);
+		}
+	}
+
+	for (u32 z = 0; z < BLOCK_COUNT_Z; z++) {
+		for (u32 j = 0; j < CHUNK_SECTION_HEIGHT; j++) {
+			u32 y = start_y + j;
+			u32 block_solid = solid[z + 1][j + 1];
+			u32 block_water = water[z + 1][j + 1];
+			u32 top_solid = solid[z + 1][j + 2];
+			u32 top_water = water[z + 1][j + 2];
+			u32 bottom_solid = solid[z + 1][j];
+			u32 bottom_water = water[z + 1][j];
+
+			// NOTE: the row with the blocks of the borders at both ends,
+			// the bit of a block is one higher than its position.
+			u32 row = block_solid << 1;
+			row |= !block_is_empty(borders[CHUNK_BORDER_LEFT][border_index(y, z)]);
+			row |= !block_is_empty(borders[CHUNK_BORDER_RIGHT][border_index(y, z)]) <<
+			    (BLOCK_COUNT_X + 1);
+
+			// NOTE: water only has top and bottom faces, which are only
+			// culled against water.
+			masks->visible[CHUNK_BORDER_RIGHT][z][j] = block_solid & ~(row >> 2);
+			masks->visible[CHUNK_BORDER_LEFT][z][j] = block_solid & ~row;
+			masks->visible[CHUNK_BORDER_TOP][z][j] =
+			    (block_solid & ~top_solid) | (block_water & ~top_water);
+			masks->visible[CHUNK_BORDER_BOTTOM][z][j] =
+			    (block_solid & ~bottom_solid) | (block_water & ~bottom_water);
+			masks->visible[CHUNK_BORDER_FRONT][z][j] = block_solid & ~solid[z + 2][j + 1];
+			masks->visible[CHUNK_BORDER_BACK][z][j] = block_solid & ~solid[z][j + 1];
+			masks->lowered[z][j] = block_water & ~(top_solid | top_water);
+
+			u32 hidden = __builtin_popcount(block_solid &
+			    ~masks->visible[CHUNK_BORDER_RIGHT][z][j] & (1 << (BLOCK_COUNT_X - 1)));
+			hidden += block_solid & ~masks->visible[CHUNK_BORDER_LEFT][z][j] & 1;
+			if (y == BLOCK_COUNT_Y - 1) {
+				hidden += __builtin_popcount((block_solid | block_water) &
+				    ~masks->visible[CHUNK_BORDER_TOP][z][j]);
+			} else if (y == 0) {
+				hidden += __builtin_popcount((block_solid | block_water) &
+				    ~masks->visible[CHUNK_BORDER_BOTTOM][z][j]);
+			}
+
+			if (z == BLOCK_COUNT_Z - 1) {
+				hidden += __builtin_popcount(block_solid &
+				    ~masks->visible[CHUNK_BORDER_FRONT][z][j]);
+			} else if (z == 0) {
+				hidden += __builtin_popcount(block_solid &
+				    ~masks->visible[CHUNK_BORDER_BACK][z][j]);
+			}
+
+			masks->hidden_border_count += hidden;
+		}
+	}
+}
+
+/*
+ * NOTE: generates the mesh of the blocks in a section of a chunk. The
+ * vertices are the corners of the blocks relative to the chunk. The faces
+ * towards the neighbours are culled against their borders. Returns the
+ * borders that have visible faces.
+ */
+static u32
+chunk_mesh(const u16 *blocks, u16 (*borders)[CHUNK_BORDER_SIZE],
+    u32 section, struct mesh_buffer *mesh, u32 *hidden_face_count)
+{
+	// NOTE: the corners of each face, the first four corners are at the
+	// top and the even corners are on the right.
+	static const u8 face_corners[CHUNK_BORDER_COUNT][4] = {
+		{ 4, 0, 6, 2 },
+		{ 1, 5, 3, 7 },
+		{ 4, 5, 0, 1 },
+		{ 7, 6, 3, 2 },
+		{ 0, 1, 2, 3 },
+		{ 5, 4, 7, 6 },
+	};
+
+	// TODO: fix bug for top faces
+	u32 visible_borders = 0;
+
+	struct chunk_face_masks masks;
+	chunk_cull_faces(blocks, borders, section, &masks);
+	*hidden_face_count += masks.hidden_border_count;
+
+	u32 section_start = section * CHUNK_SECTION_HEIGHT;
+	for (u32 f = 0; f < CHUNK_BORDER_COUNT; f++) {
+		for (u32 z = 0; z < BLOCK_COUNT_Z; z++) {
+			for (u32 j = 0; j < CHUNK_SECTION_HEIGHT; j++) {
+				u32 y = section_start + j;
+				u32 visible = masks.visible[f][z][j];
+
+				// NOTE: the blocks of the row that are at the border
+				u32 border_mask = 0;
+				if (f == CHUNK_BORDER_RIGHT) {
+					border_mask = 1 << (BLOCK_COUNT_X - 1);
+				} else if (f == CHUNK_BORDER_LEFT) {
+					border_mask = 1;
+				} else if ((f == CHUNK_BORDER_TOP && y == BLOCK_COUNT_Y - 1) ||
+				    (f == CHUNK_BORDER_BOTTOM && y == 0) ||
+				    (f == CHUNK_BORDER_FRONT && z == BLOCK_COUNT_Z - 1) ||
+				    (f == CHUNK_BORDER_BACK && z == 0)) {
+					border_mask = ~0;
+				}
+
+				visible_borders |= ((visible & border_mask) != 0) << f;
+
+				while (visible) {
+					u32 x = __builtin_ctz(visible);
+					visible &= visible - 1;
+
+					u32 block = blocks[block_index(x, y, z)];
+					u32 is_lowered = (masks.lowered[z][j] >> x) & 1;
+					u32 tile = chunk_face_tile(f, block);
+					struct mesh_vertex vertex[4];
+					for (u32 k = 0; k < 4; k++) {
+						u32 corner = face_corners[f][k];
+						u32 is_top = !(corner & 2);
+						vertex[k] = mesh_vertex(x + !(corner & 1), y + is_top,
+						    z + !(corner & 4), f, is_lowered && is_top, tile);
+					}
+
+					mesh_push_quad(mesh, vertex[0], vertex[1], vertex[2], vertex[3]);
+				}
+			}
+		}
+	}
+
+	return visible_borders;
+}
+
+/*
+ * NOTE: pushes a rectangle of faces in the slice of the chunk. The slice is
+ * the position of the blocks along the normal of the face, the rectangle
+ * starts at u and v along the axes of the face.
+ */
+static void
+chunk_push_face(struct mesh_buffer *mesh, u32 f, i32 d, u32 u, u32 v,
+    u32 width, u32 height, u32 tile, u32 is_lowered)
+{
+	u32 normal_axis = chunk_faces[f].normal;
+	u32 u_axis = chunk_faces[f].u;
+	u32 v_axis = chunk_faces[f].v;
+
+	// NOTE: the texture starts at the first corner
+	u32 u_start = u, u_end = u + width;
+	if (chunk_faces[f].u_dir < 0) {
+		u_start = u_end;
+		u_end = u;
+	}
+
+	u32 v_start = v, v_end = v + height;
+	if (chunk_faces[f].v_dir < 0) {
+		v_start = v_end;
+		v_end = v;
+	}
+
+	struct mesh_vertex vertex[4];
+	for (u32 k = 0; k < 4; k++) {
+		u32 pos[3];
+		pos[normal_axis] = d + (chunk_faces[f].normal_dir > 0);
+		pos[u_axis] = k & 1 ? u_end : u_start;
+		pos[v_axis] = k & 2 ? v_end : v_start;
+		vertex[k] = mesh_vertex(pos[0], pos[1], pos[2], f, is_lowered, tile);
+	}
+
+	mesh_push_quad(mesh, vertex[0], vertex[1], vertex[2], vertex[3]);
+}
+
+/*
+ * NOTE: generates the same faces as chunk_mesh, but merges the faces of the
+ * same block in each slice into rectangles. The faces are first collected in
+ * a mask, which is indexed by the two axes of the face. The rectangles grow
+ * along the first axis and then along the second one, but never beyond the
+ * section.
+ */
+static u32
+chunk_mesh_greedy(const u16 *blocks, u16 (*borders)[CHUNK_BORDER_SIZE],
+    u32 section, struct mesh_buffer *mesh, u32 *hidden_face_count)
+{
+	static_assert(BLOCK_COUNT_X == BLOCK_COUNT_Y && BLOCK_COUNT_Y == BLOCK_COUNT_Z,
+	    "The greedy mesher expects cubic chunks");
+
+	const i32 size = BLOCK_COUNT_X;
+	const u16 lowered_water = 0x100;
+	u32 visible_borders = 0;
+
+	i32 start[3] = { 0, section * CHUNK_SECTION_HEIGHT, 0 };
+	i32 end[3] = { size, start[1] + CHUNK_SECTION_HEIGHT, size };
+
+	struct chunk_face_masks masks;
+	chunk_cull_faces(blocks, borders, section, &masks);
+	*hidden_face_count += masks.hidden_border_count;
+
+	for (u32 f = 0; f < CHUNK_BORDER_COUNT; f++) {
+		u32 normal_axis = chunk_faces[f].normal;
+		u32 u_axis = chunk_faces[f].u;
+		u32 v_axis = chunk_faces[f].v;
+		i32 normal_dir = chunk_faces[f].normal_dir;
+		bool is_top = normal_axis == 1 && normal_dir > 0;
+
+		i32 u_start = start[u_axis], u_end = end[u_axis];
+		i32 v_start = start[v_axis], v_end = end[v_axis];
+		for (i32 d = start[normal_axis]; d < end[normal_axis]; d++) {
+			u16 mask[BLOCK_COUNT_X][BLOCK_COUNT_X];
+			bool is_border = d + normal_dir < 0 || d + normal_dir >= size;
+
+			// NOTE: a zero entry is a hidden face, otherwise the entry is
+			// the block with the flag for lowered water surfaces.
+			for (i32 v = v_start; v < v_end; v++) {
+				for (i32 u = u_start; u < u_end; u++) {
+					i32 pos[3];
+					pos[normal_axis] = d;
+					pos[u_axis] = u;
+					pos[v_axis] = v;
+
+					u32 j = pos[1] - start[1];
+					u32 visible = masks.visible[f][pos[2]][j] >> pos[0];
+					mask[v][u] = 0;
+					if (visible & 1) {
+						u32 i = block_index(pos[0], pos[1], pos[2]);
+						u32 is_lowered = is_top && ((masks.lowered[pos[2]][j] >> pos[0]) & 1);
+						mask[v][u] = blocks[i] | (is_lowered ? lowered_water : 0);
+					}
+				}
+			}
+
+			for (i32 v = v_start; v < v_end; v++) {
+				for (i32 u = u_start; u < u_end; u++) {
+					u16 entry = mask[v][u];
+					if (!entry) {
+						continue;
+					}
+
+					visible_borders |= is_border << f;
+
+					i32 width = 1;
+					while (u + width < u_end && mask[v][u + width] == entry) {
+						width++;
+					}
+
+					i32 height = 1;
+					while (v + height < v_end) {
+						i32 i = 0;
+						while (i < width && mask[v + height][u + i] == entry) {
+							i++;
+						}
+
+						if (i < width) {
+							break;
+						}
+
+						height++;
+					}
+
+					for (i32 j = 0; j < height; j++) {
+						for (i32 i = 0; i < width; i++) {
+							mask[v + j][u + i] = 0;
+						}
+					}
+
+					u32 tile = chunk_face_tile(f, entry & 0xff);
+					u32 is_lowered = (entry & lowered_water) != 0;
+					chunk_push_face(mesh, f, d, u, v, width, height,
+					    tile, is_lowered);
+				}
+			}
+		}
+	}
+
+	return visible_borders;
+}
+
+/*
+ * NOTE: downsamples the blocks for the level of detail. Every cell of two or
+ * four blocks along each axis is filled with its most common block. A cell is
+ * only empty if more than half of its blocks are empty, so that thin layers
+ * of blocks at the surface don't disappear.
+ */
+static void
+chunk_downsample(const u16 *blocks, u32 lod, u16 *result)
+{
+	u32 cell_size = 1 << lod;
+	u32 cell_volume = cell_size * cell_size * cell_size;
+
+	for (u32 z = 0; z < BLOCK_COUNT_Z; z += cell_size) {
+		for (u32 y = 0; y < BLOCK_COUNT_Y; y += cell_size) {
+			for (u32 x = 0; x < BLOCK_COUNT_X; x += cell_size) {
+				u8 counts[CHUNK_PALETTE_SIZE] = {0};
+				u32 empty_count = 0;
+				for (u32 k = 0; k < cell_size; k++) {
+					for (u32 j = 0; j < cell_size; j++) {
+						for (u32 i = 0; i < cell_size; i++) {
+							u32 block = blocks[block_index(x + i, y + j, z + k)];
+							assert(block < CHUNK_PALETTE_SIZE);
+							empty_count += block_is_empty(block);
+							counts[block]++;
+						}
+					}
+				}
+
+				bool is_empty = 2 * empty_count > cell_volume;
+				u32 cell_block = BLOCK_AIR;
+				for (u32 block = 0; block < CHUNK_PALETTE_SIZE; block++) {
+					if (block_is_empty(block) == is_empty &&
+					    counts[block] > counts[cell_block]) {
+						cell_block = block;
+					}
+				}
+
+				for (u32 k = 0; k < cell_size; k++) {
+					for (u32 j = 0; j < cell_size; j++) {
+						for (u32 i = 0; i < cell_size; i++) {
+							result[block_index(x + i, y + j, z + k)] = cell_block;
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+/*
+ * NOTE: meshes the downsampled blocks of a chunk with the greedy mesher. The
+ * neighbours are meshed at any level and cull their faces against the blocks
+ * of the chunk, not against its downsampled blocks. So the faces of the
+ * chunk at a border are only culled if the blocks on both sides of the border
+ * are not empty. Where a neighbour culled its face, but the downsampled block
+ * is empty, a skirt closes the hole. The skirt is the face of the neighbour
+ * at the border, which faces towards the chunk.
+ */
+static u32
+chunk_mesh_lod(const u16 *blocks, const u16 *lod_blocks,
+    u16 (*borders)[CHUNK_BORDER_SIZE], u32 section, struct mesh_buffer *mesh,
+    u32 *hidden_face_count)
+{
+	const i32 size = BLOCK_COUNT_X;
+	const i32 stride[3] = { 1, BLOCK_COUNT_X, BLOCK_COUNT_X * BLOCK_COUNT_Y };
+	// NOTE: the culler also reads the rows of the front and back borders
+	// next to the section, so the borders are cleared to air first.
+	u16 lod_borders[CHUNK_BORDER_COUNT][CHUNK_BORDER_SIZE] = {0};
+
+	i32 start[3] = { 0, section * CHUNK_SECTION_HEIGHT, 0 };
+	i32 end[3] = { size, start[1] + CHUNK_SECTION_HEIGHT, size };
+
+	for (u32 f = 0; f < CHUNK_BORDER_COUNT; f++) {
+		u32 normal_axis = chunk_faces[f].normal;
+		u32 u_axis = chunk_faces[f].u;
+		u32 v_axis = chunk_faces[f].v;
+		i32 d = chunk_faces[f].normal_dir > 0 ? size - 1 : 0;
+
+		i32 border_stride_u = BLOCK_COUNT_X, border_stride_v = 1;
+		if (u_axis < v_axis) {
+			border_stride_u = 1;
+			border_stride_v = BLOCK_COUNT_X;
+		}
+
+		// NOTE: the greedy mesher only reads the borders of the section
+		if (d < start[normal_axis] || d >= end[normal_axis]) {
+			continue;
+		}
+
+		for (i32 v = start[v_axis]; v < end[v_axis]; v++) {
+			for (i32 u = start[u_axis]; u < end[u_axis]; u++) {
+				u32 i = d * stride[normal_axis] + u * stride[u_axis] +
+				    v * stride[v_axis];
+				u32 j = u * border_stride_u + v * border_stride_v;
+
+				u16 next = borders[f][j];
+				lod_borders[f][j] = next;
+				if (block_is_empty(next)) {
+					continue;
+				}
+
+				if (block_is_empty(blocks[i])) {
+					lod_borders[f][j] = BLOCK_AIR;
+				} else if (block_is_empty(lod_blocks[i])) {
+					u32 tile = chunk_face_tile(f ^ 1, next);
+					chunk_push_face(mesh, f ^ 1, d + chunk_faces[f].normal_dir,
+					    u, v, 1, 1, tile, 0);
+				}
+			}
+		}
+	}
+
+	u32 visible_borders = chunk_mesh_greedy(lod_blocks, lod_borders, section,
+	    mesh, hidden_face_count);
+	return visible_borders;
+}
+
+/*
+ * NOTE: flood fills the empty blocks of a chunk from its borders to find
+ * which borders are connected. The search can only see through a chunk
+ * from one border to another if they are connected. The stack of the search
+ * is allocated from the scratch arena.
+ */
+static void
+chunk_connect_borders(const u16 *blocks, u8 *connections, struct arena *scratch)
+{
+	struct arena_temp temp = arena_begin_temp(scratch);
+	u64 is_visited[BLOCK_COUNT / 64] = {0};
+	u16 *stack = ALLOC(scratch, BLOCK_COUNT, u16);
+
+	memset(connections, 0, CHUNK_BORDER_COUNT);
+	for (u32 i = 0; i < BLOCK_COUNT; i++) {
+		u32 x = i % BLOCK_COUNT_X;
+		u32 y = i / BLOCK_COUNT_X % BLOCK_COUNT_Y;
+		u32 z = i / (BLOCK_COUNT_X * BLOCK_COUNT_Y);
+		bool is_border = x == 0 || x == BLOCK_COUNT_X - 1 ||
+		    y == 0 || y == BLOCK_COUNT_Y - 1 ||
+		    z == 0 || z == BLOCK_COUNT_Z - 1;
+		if (!is_border || (is_visited[i / 64] & (1ull << (i % 64))) ||
+		    !block_is_empty(blocks[i])) {
+			continue;
+		}
+
+		u32 borders = 0;
+		u32 stack_count = 0;
+		stack[stack_count++] = i;
+		is_visited[i / 64] |= 1ull << (i % 64);
+		while (stack_count > 0) {
+			u32 j = stack[--stack_count];
+			u32 pos[3] = {
+				j % BLOCK_COUNT_X,
+				j / BLOCK_COUNT_X % BLOCK_COUNT_Y,
+				j / (BLOCK_COUNT_X * BLOCK_COUNT_Y),
+			};
+
+			u32 stride[3] = { 1, BLOCK_COUNT_X, BLOCK_COUNT_X * BLOCK_COUNT_Y };
+			for (u32 axis = 0; axis < 3; axis++) {
+				// NOTE: the borders are in the order of the axes, the
+				// positive border comes first.
+				u32 neighbors[2] = { j + stride[axis], j - stride[axis] };
+				bool is_inside[2] = { pos[axis] < BLOCK_COUNT_X - 1, pos[axis] > 0 };
+				for (u32 side = 0; side < 2; side++) {
+					u32 k = neighbors[side];
+					if (!is_inside[side]) {
+						borders |= 1 << (2 * axis + side);
+					} else if (!(is_visited[k / 64] & (1ull << (k % 64))) &&
+					    block_is_empty(blocks[k])) {
+						is_visited[k / 64] |= 1ull << (k % 64);
+						stack[stack_count++] = k;
+					}
+				}
+			}
+		}
+
+		for (u32 border = 0; border < CHUNK_BORDER_COUNT; border++) {
+			if (borders & (1 << border)) {
+				connections[border] |= borders;
+			}
+		}
+	}
+
+	arena_end_temp(temp);
+}
+
+// NOTE: returns the offset from the player to the center of the chunk
+static v3
+world_get_chunk_offset(const struct world *world, v3i coord)
+{
+	v3 chunk_pos = v3(coord.x * BLOCK_COUNT_X, coord.y * BLOCK_COUNT_Y,
+	    coord.z * BLOCK_COUNT_Z);
+	v3 chunk_half_dim = mulf(v3(BLOCK_COUNT_X, BLOCK_COUNT_Y, BLOCK_COUNT_Z), 0.5f);
+	chunk_pos = add(chunk_pos, chunk_half_dim);
+
+	v3 offset = sub(chunk_pos, world->load_pos);
+	return offset;
+}
+
+// NOTE: the priority is the squared distance to the chunk, scaled from one
+// for chunks in front of the camera up to three for chunks behind it. So
+// chunks behind the camera are loaded as if they were up to about 1.7 times
+// farther away.
+static f32
+world_get_load_priority(const struct world *world, v3i coord)
+{
+	v3 offset = world_get_chunk_offset(world, coord);
+	f32 distance_sq = length_sq(offset);
+	f32 facing = 0.0f;
+	if (distance_sq > 0.0f) {
+		facing = dot(offset, world->load_dir) / sqrtf(distance_sq);
+	}
+
+	f32 result = distance_sq * (2.0f - facing);
+	return result;
+}
+
+static void
+world_sift_up(struct world *world, u32 i)
+{
+	struct chunk_queue_entry *queue = world->load_queue;
+	struct chunk_queue_entry entry = queue[i];
+
+	while (i > 0) {
+		u32 parent = (i - 1) / 2;
+		if (queue[parent].priority <= entry.priority) {
+			break;
+		}
+
+		queue[i] = queue[parent];
+		i = parent;
+	}
+
+	queue[i] = entry;
+}
+
+static void
+world_sift_down(struct world *world, u32 i)
+{
+	struct chunk_queue_entry *queue = world->load_queue;
+	struct chunk_queue_entry entry = queue[i];
+	u32 count = world->load_queue_count;
+
+	for (;;) {
+		u32 child = 2 * i + 1;
+		if (child >= count) {
+			break;
+		}
+
+		if (child + 1 < count && queue[child + 1].priority < queue[child].priority) {
+			child++;
+		}
+
+		if (entry.priority <= queue[child].priority) {
+			break;
+		}
+
+		queue[i] = queue[child];
+		i = child;
+	}
+
+	queue[i] = entry;
+}
+
+static void
+world_queue_chunk(struct world *world, struct chunk *chunk)
+{
+	assert(chunk->state == CHUNK_UNLOADED || chunk->state == CHUNK_DIRTY);
+	assert(world->load_queue_count < world->max_chunk_count);
+
+	u32 i = world->load_queue_count++;
+	world->load_queue[i].coord = chunk->coord;
+	world->load_queue[i].priority = world_get_load_priority(world, chunk->coord);
+	world_sift_up(world, i);
+}
+
+static v3i
+world_pop_queue(struct world *world)
+{
+	assert(world->load_queue_count > 0);
+
+	v3i result = world->load_queue[0].coord;
+	world->load_queue[0] = world->load_queue[--world->load_queue_count];
+	if (world->load_queue_count > 0) {
+		world_sift_down(world, 0);
+	}
+
+	return result;
+}
+
+// NOTE: rebuilds the queue from the resident chunks in linear time
+// NOTE: waiting chunks are queued again if their pending neighbours were
+// unloaded and evicted chunks once they are closer than the mesh distance.
+static void
+world_rebuild_queue(struct world *world)
+{
+	world->load_queue_count = 0;
+	for (u32 i = 0; i < world->chunk_count; i++) {
+		struct chunk *chunk = &world->chunks[i];
+		if (chunk->state == CHUNK_WAITING &&
+		    !world_has_pending_neighbors(world, chunk->coord)) {
+			chunk->state = CHUNK_DIRTY;
+		}
+
+		if (chunk->state == CHUNK_EVICTED &&
+		    length_sq(world_get_chunk_offset(world, chunk->coord)) <
+		    world->mesh_distance_sq) {
+			chunk->state = CHUNK_DIRTY;
+		}
+
+		if (chunk->state == CHUNK_UNLOADED || chunk->state == CHUNK_DIRTY) {
+			u32 j = world->load_queue_count++;
+			world->load_queue[j].coord = chunk->coord;
+			world->load_queue[j].priority = world_get_load_priority(world, chunk->coord);
+		}
+	}
+
+	for (u32 i = world->load_queue_count / 2; i-- > 0;) {
+		world_sift_down(world, i);
+	}
+}
+
+static void
+world_mark_sections_dirty(struct world *world, struct chunk *chunk,
+    u32 section_mask)
+{
+	chunk->dirty_sections |= section_mask;
+	if (chunk->state != CHUNK_UNLOADED && chunk->state != CHUNK_DIRTY) {
+		chunk->state = CHUNK_DIRTY;
+		world_queue_chunk(world, chunk);
+	}
+}
+
+static void
+world_mark_dirty(struct world *world, struct chunk *chunk)
+{
+	world_mark_sections_dirty(world, chunk, CHUNK_ALL_SECTIONS);
+}
+
+// NOTE: the chunks are meshed again with the new mode, the loading chunks
+// are meshed again once they are generated.
+static void
+world_set_mesh_mode(struct world *world, enum chunk_mesh_mode mesh_mode)
+{
+	if (world->mesh_mode != mesh_mode) {
+		world->mesh_mode = mesh_mode;
+
+		for (u32 i = 0; i < world->chunk_count; i++) {
+			struct chunk *chunk = &world->chunks[i];
+			chunk->dirty_sections = CHUNK_ALL_SECTIONS;
+			if (chunk->state == CHUNK_READY || chunk->state == CHUNK_MESHING) {
+				world_mark_dirty(world, chunk);
+			}
+		}
+	}
+}
+
+/*
+ * NOTE: chunks that are meshed or were meshed at another level of detail are
+ * meshed again. The other chunks are meshed at their new level once they are
+ * meshed. Chunks that are generated right now are meshed again once the job
+ * is done.
+ */
+static void
+world_update_lods(struct world *world)
+{
+	u32 max_lod = world->is_lod_enabled ? CHUNK_LOD_COUNT - 1 : 0;
+	for (u32 i = 0; i < world->chunk_count; i++) {
+		struct chunk *chunk = &world->chunks[i];
+		f32 distance = sqrtf(length_sq(world_get_chunk_offset(world, chunk->coord)));
+
+		u32 lod = MIN(chunk->lod, max_lod);
+		while (lod < max_lod && distance >
+		    CHUNK_LOD_DISTANCE * (lod + 1) + CHUNK_LOD_HYSTERESIS) {
+			lod++;
+		}
+
+		while (lod > 0 && distance < CHUNK_LOD_DISTANCE * lod - CHUNK_LOD_HYSTERESIS) {
+			lod--;
+		}
+
+		if (chunk->lod != lod) {
+			chunk->lod = lod;
+			chunk->dirty_sections = CHUNK_ALL_SECTIONS;
+			if (chunk->state == CHUNK_READY || chunk->state == CHUNK_MESHING) {
+				world_mark_dirty(world, chunk);
+			}
+		}
+	}
+}
+
+// NOTE: the limits are derived from the costs of the previous frames
+static void
+world_begin_stages(struct world *world)
+{
+	for (u32 i = 0; i < CHUNK_STAGE_COUNT; i++) {
+		struct chunk_stage_stats *stats = &world->stages[i];
+		f32 limit = stats->budget / MAX(stats->cost, 0.001f);
+
+		stats->limit = CLAMP(limit, 1, MAX_CHUNK_COUNT);
+		stats->time = 0;
+		stats->count = 0;
+	}
+}
+
+static bool
+world_has_stage_budget(const struct world *world, enum chunk_stage stage)
+{
+	const struct chunk_stage_stats *stats = &world->stages[stage];
+	bool result = stats->count == 0 ||
+	    (stats->count < stats->limit && stats->time < stats->budget);
+	return result;
+}
+
+static void
+world_end_stage(struct world *world, enum chunk_stage stage, f64 start_time)
+{
+	struct chunk_stage_stats *stats = &world->stages[stage];
+	f32 time = 1000.0 * (get_time_sec() - start_time);
+
+	stats->cost = stats->cost > 0 ? lerp(stats->cost, time, 0.05f) : time;
+	stats->time += time;
+	stats->count++;
+}
+
+static void
+world_add_worker_cost(struct world *world, enum chunk_stage stage, f32 time)
+{
+	struct chunk_stage_stats *stats = &world->stages[stage];
+	stats->worker_cost = stats->worker_cost > 0 ?
+	    lerp(stats->worker_cost, time, 0.05f) : time;
+}
+
+static void
+world_run_chunk_job(void *data, struct arena *scratch)
+{
+	struct chunk_job *job = data;
+	f64 start_time = get_time_sec();
+
+	if (job->type == CHUNK_JOB_GENERATE) {
+		if (!job->column.has_heights) {
+			column_compute_heights(&job->column);
+		}
+
+		job->is_uniform = chunk_generate(&job->column, job->coord, job->blocks);
+	}
+
+	if (job->is_uniform) {
+		u32 borders = block_is_empty(job->blocks[0]) ? (1 << CHUNK_BORDER_COUNT) - 1 : 0;
+		memset(job->connections, borders, sizeof(job->connections));
+	} else if (job->has_connections) {
+		chunk_connect_borders(job->blocks, job->connections, scratch);
+	}
+
+	f64 generate_time = get_time_sec();
+
+	struct mesh_buffer *mesh = &job->mesh;
+
+	job->open_borders = 0;
+	job->hidden_face_count = 0;
+	if (job->has_mesh && !job->is_uniform) {
+		// NOTE: the downsampled blocks can connect borders that the blocks
+		// of the chunk don't connect.
+		u16 *lod_blocks = NULL;
+		if (job->lod > 0) {
+			lod_blocks = ALLOC(scratch, BLOCK_COUNT, u16);
+			chunk_downsample(job->blocks, job->lod, lod_blocks);
+		}
+
+		if (job->lod > 0 && job->has_connections) {
+			u8 lod_connections[CHUNK_BORDER_COUNT];
+			chunk_connect_borders(lod_blocks, lod_connections, scratch);
+			for (u32 i = 0; i < CHUNK_BORDER_COUNT; i++) {
+				job->connections[i] |= lod_connections[i];
+			}
+		}
+
+		u32 visible_borders = 0;
+		for (u32 i = 0; i < CHUNK_SECTION_COUNT; i++) {
+			if (job->section_mask & (1 << i)) {
+				u32 section_borders;
+				u32 offset = mesh->vertex_count;
+				u32 *hidden_face_count = &job->hidden_face_count;
+				if (job->lod > 0) {
+					section_borders = chunk_mesh_lod(job->blocks, lod_blocks,
+					    job->borders, i, mesh, hidden_face_count);
+				} else if (job->mesh_mode == CHUNK_MESH_GREEDY) {
+					section_borders = chunk_mesh_greedy(job->blocks,
+					    job->borders, i, mesh, hidden_face_count);
+				} else {
+					section_borders = chunk_mesh(job->blocks, job->borders,
+					    i, mesh, hidden_face_count);
+				}
+
+				job->section_offsets[i] = offset;
+				job->section_vertex_counts[i] = mesh->vertex_count - offset;
+				job->section_borders[i] = section_borders;
+			}
+
+			visible_borders |= job->section_borders[i];
+		}
+
+		job->open_borders = visible_borders & ~job->neighbor_mask;
+	} else {
+		mesh->vertex_count = 0;
+		job->has_mesh = 0;
+	}
+
+	job->generate_time = 1000.0 * (generate_time - start_time);
+	job->mesh_time = 1000.0 * (get_time_sec() - generate_time);
+	__atomic_store_n(&job->is_done, 1, __ATOMIC_RELEASE);
+}
+
+// NOTE: frees the mesh of a chunk and stops meshing chunks that are as far
+// away as the chunk.
+static void
+world_free_chunk_mesh(struct world *world, struct chunk *chunk,
+    struct renderer *renderer)
+{
+	if (chunk->mesh != 0) {
+		renderer_free_mesh(renderer, chunk->mesh);
+		chunk->mesh = 0;
+		world->evicted_mesh_count++;
+	}
+
+	f32 distance_sq = length_sq(world_get_chunk_offset(world, chunk->coord));
+	world->mesh_distance_sq = MIN(world->mesh_distance_sq, distance_sq);
+}
+
+// NOTE: the chunk must not be in the load queue
+static void
+world_evict_chunk(struct world *world, struct chunk *chunk,
+    struct renderer *renderer)
+{
+	world_free_chunk_mesh(world, chunk, renderer);
+	world_free_cache(world, chunk);
+	chunk->open_borders = 0;
+	chunk->state = CHUNK_EVICTED;
+}
+
+/*
+ * NOTE: copies the sections of the mesh of the job into the cache in order.
+ * The chunk stays without a cached mesh if the cache is full.
+ */
+static void
+world_cache_mesh(struct world *world, struct chunk *chunk,
+    const struct chunk_job *job)
+{
+	u32 vertex_count = job->mesh.vertex_count;
+	if (chunk->cache_capacity < vertex_count) {
+		world_free_cache(world, chunk);
+
+		u32 capacity = (vertex_count + MESH_VERTEX_GRANULARITY - 1) &
+		    ~(MESH_VERTEX_GRANULARITY - 1);
+		if (!mesh_allocator_alloc(&world->cache_allocator, capacity,
+		    &chunk->cache_offset)) {
+			return;
+		}
+
+		chunk->cache_capacity = capacity;
+	}
+
+	struct mesh_vertex *vertices = world->cache + chunk->cache_offset;
+	for (u32 i = 0; i < CHUNK_SECTION_COUNT; i++) {
+		u32 section_vertex_count = job->section_vertex_counts[i];
+		memcpy(vertices, job->mesh.vertices + job->section_offsets[i],
+		    section_vertex_count * sizeof(*vertices));
+		vertices += section_vertex_count;
+
+		chunk->section_vertex_counts[i] = section_vertex_count;
+		chunk->section_borders[i] = job->section_borders[i];
+	}
+
+	chunk->dirty_sections = 0;
+}
+
+/*
+ * NOTE: chunks without visible faces don't need a mesh, so their mesh is
+ * freed. The chunk is evicted if the renderer has no free meshes left.
+ * Returns false if the chunk was evicted, otherwise the mesh is cached.
+ */
+static bool
+world_upload_mesh(struct world *world, struct chunk *chunk,
+    const struct chunk_job *job, struct renderer *renderer)
+{
+	const struct mesh_buffer *mesh = &job->mesh;
+	if (mesh->vertex_count == 0) {
+		renderer_free_mesh(renderer, chunk->mesh);
+		chunk->mesh = 0;
+	} else if (!renderer_build_mesh(renderer, mesh, &chunk->mesh)) {
+		world_evict_chunk(world, chunk, renderer);
+		return false;
+	}
 
-			next = v3_sub(point, offset);
-			next_chunk = world_get_chunk(world, next.x, next.y, next.z);
-			next_chunk->state = CHUNK_DIRTY;
+	world_cache_mesh(world, chunk, job);
+	return true;
+}
+
+/*
+ * NOTE: evicts the meshes of the farthest chunks while the meshes use more
+ * memory than their budget. Chunks that are not ready only lose their old
+ * mesh, they are evicted once they are meshed again. The chunks with a mesh
+ * are sorted once by their distance, the key contains the bits of the
+ * squared distance above the index of the chunk. The bits of positive floats
+ * sort in the same order as their values.
+ */
+static void
+world_evict_meshes(struct world *world, struct renderer *renderer)
+{
+	usize memory = renderer_get_mesh_memory(renderer);
+	if (memory <= renderer->mesh_memory_budget) {
+		return;
+	}
+
+	struct arena_temp temp = arena_begin_temp(world->arena);
+	u64 *keys = ALLOC(world->arena, world->chunk_count, u64);
+	u64 *buffer = ALLOC(world->arena, world->chunk_count, u64);
+
+	u32 key_count = 0;
+	for (u32 i = 0; i < world->chunk_count; i++) {
+		struct chunk *chunk = &world->chunks[i];
+		if (chunk->mesh != 0) {
+			f32 distance_sq = length_sq(world_get_chunk_offset(world, chunk->coord));
+			u32 distance_bits;
+			memcpy(&distance_bits, &distance_sq, sizeof(distance_bits));
+			keys[key_count++] = (u64)distance_bits << 32 | i;
+		}
+	}
+
+	keys = render_sort_keys(keys, buffer, key_count);
+
+	usize excess = memory - renderer->mesh_memory_budget;
+	usize freed = 0;
+	while (freed < excess && key_count > 0) {
+		struct chunk *chunk = &world->chunks[(u32)keys[--key_count]];
+		freed += renderer_get_mesh_size(renderer, chunk->mesh);
+		if (chunk->state == CHUNK_READY) {
+			world_evict_chunk(world, chunk, renderer);
+		} else {
+			world_free_chunk_mesh(world, chunk, renderer);
+		}
+	}
+
+	arena_end_temp(temp);
+}
+
+// NOTE: chunks without visible faces don't need a mesh
+static void
+world_finish_hidden_chunk(struct world *world, struct chunk *chunk,
+    struct renderer *renderer)
+{
+	renderer_free_mesh(renderer, chunk->mesh);
+	chunk->mesh = 0;
+	world_free_cache(world, chunk);
+	chunk->open_borders = 0;
+	chunk->state = CHUNK_READY;
+}
+
+static u32
+world_get_neighbor_mask(struct world *world, v3i coord)
+{
+	u32 neighbor_mask = 0;
+	for (u32 i = 0; i < CHUNK_BORDER_COUNT; i++) {
+		if (world_lookup_neighbor(world, coord, i)) {
+			neighbor_mask |= 1 << i;
+		}
+	}
+
+	return neighbor_mask;
+}
+
+// NOTE: copies the blocks of the neighbours next to the chunk, the borders
+// of missing neighbours only contain air.
+static u32
+world_copy_borders(struct world *world, v3i coord,
+    u16 (*borders)[CHUNK_BORDER_SIZE])
+{
+	u32 neighbor_mask = 0;
+	for (u32 i = 0; i < CHUNK_BORDER_COUNT; i++) {
+		u16 *border = borders[i];
+		struct chunk *neighbor = world_lookup_neighbor(world, coord, i);
+		if (!neighbor) {
+			memset(border, 0, sizeof(*borders));
+			continue;
+		}
+
+		neighbor_mask |= 1 << i;
+		if (neighbor->bits_per_block == 0) {
+			for (u32 j = 0; j < CHUNK_BORDER_SIZE; j++) {
+				border[j] = neighbor->palette[0];
+			}
+
+			continue;
+		}
+
+		u32 axis = i / 2;
+		u32 a_axis = axis == 0 ? 1 : 0;
+		u32 b_axis = axis == 2 ? 1 : 2;
+		i32 p[3];
+		p[axis] = i & 1 ? BLOCK_COUNT_X - 1 : 0;
+		for (p[b_axis] = 0; p[b_axis] < BLOCK_COUNT_X; p[b_axis]++) {
+			for (p[a_axis] = 0; p[a_axis] < BLOCK_COUNT_X; p[a_axis]++) {
+				u32 j = border_index(p[a_axis], p[b_axis]);
+				border[j] = chunk_at(neighbor, p[0], p[1], p[2]);
+			}
+		}
+	}
+
+	return neighbor_mask;
+}
+
+/*
+ * NOTE: the waiting neighbours of a newly generated chunk are meshed once
+ * none of their neighbours are pending anymore. The neighbours with visible
+ * faces towards the chunk are meshed again, unless the chunk only contains
+ * air at that border. Neighbours that are meshed right now are checked once
+ * their job is done.
+ */
+static void
+world_update_neighbors(struct world *world, struct chunk *chunk,
+    const u16 *blocks, bool is_uniform)
+{
+	for (u32 i = 0; i < CHUNK_BORDER_COUNT; i++) {
+		struct chunk *neighbor = world_lookup_neighbor(world, chunk->coord, i);
+		if (neighbor && neighbor->state == CHUNK_WAITING &&
+		    !world_has_pending_neighbors(world, neighbor->coord)) {
+			neighbor->state = CHUNK_DIRTY;
+			world_queue_chunk(world, neighbor);
+			continue;
+		}
+
+		if (!neighbor || neighbor->state != CHUNK_READY ||
+		    !(neighbor->open_borders & (1 << (i ^ 1)))) {
+			continue;
+		}
+
+		bool is_empty = true;
+		if (is_uniform) {
+			is_empty = blocks[0] == BLOCK_AIR;
+		} else {
+			u32 axis = i / 2;
+			u32 a_axis = axis == 0 ? 1 : 0;
+			u32 b_axis = axis == 2 ? 1 : 2;
+			i32 p[3];
+			p[axis] = i & 1 ? 0 : BLOCK_COUNT_X - 1;
+			for (p[b_axis] = 0; is_empty && p[b_axis] < BLOCK_COUNT_X; p[b_axis]++) {
+				for (p[a_axis] = 0; p[a_axis] < BLOCK_COUNT_X; p[a_axis]++) {
+					if (blocks[block_index(p[0], p[1], p[2])] != BLOCK_AIR) {
+						is_empty = false;
+						break;
+					}
+				}
+			}
+		}
+
+		if (!is_empty) {
+			world_mark_dirty(world, neighbor);
+		}
+	}
+}
+
+static struct chunk_job *
+world_start_chunk_job(struct world *world, struct chunk *chunk,
+    struct game_assets *assets)
+{
+	struct chunk_job *job = 0;
+	for (u32 i = 0; i < MAX_CHUNK_JOB_COUNT; i++) {
+		if (!world->jobs[i].is_active) {
+			job = &world->jobs[i];
+			break;
+		}
+	}
+
+	if (job) {
+		if (chunk->state == CHUNK_UNLOADED) {
+			struct chunk_column *column = world_lookup_column(world, chunk->coord);
+			assert(column);
+
+			job->type = CHUNK_JOB_GENERATE;
+			job->column = *column;
+			chunk->state = CHUNK_LOADING;
+		} else {
+			assert(chunk->state == CHUNK_DIRTY);
+			job->type = CHUNK_JOB_MESH;
+			chunk_unpack(chunk, job->blocks);
+			chunk->state = CHUNK_MESHING;
+		}
+
+		job->coord = chunk->coord;
+		job->is_active = 1;
+		job->is_done = 0;
+		job->is_uniform = 0;
+		job->mesh_mode = world->mesh_mode;
+		job->lod = chunk->lod;
+		job->has_mesh = job->type == CHUNK_JOB_MESH ||
+		    !world_has_pending_neighbors(world, chunk->coord);
+		if (job->has_mesh) {
+			job->neighbor_mask = world_copy_borders(world, chunk->coord, job->borders);
+		}
+
+		// NOTE: the sections that are not dirty are copied from the cache
+		struct mesh_buffer *mesh = &job->mesh;
+		struct mesh_vertex *cached_vertices = world->cache + chunk->cache_offset;
+		mesh->vertex_count = 0;
+		job->section_mask = chunk->dirty_sections;
+		job->has_connections = job->type == CHUNK_JOB_GENERATE ||
+		    job->section_mask == CHUNK_ALL_SECTIONS || chunk->has_outdated_connections;
+		for (u32 i = 0; i < CHUNK_SECTION_COUNT; i++) {
+			u32 section_vertex_count = chunk->section_vertex_counts[i];
+			if (!(job->section_mask & (1 << i))) {
+				memcpy(mesh->vertices + mesh->vertex_count, cached_vertices,
+				    section_vertex_count * sizeof(*cached_vertices));
+				job->section_offsets[i] = mesh->vertex_count;
+				job->section_vertex_counts[i] = section_vertex_count;
+				job->section_borders[i] = chunk->section_borders[i];
+				mesh->vertex_count += section_vertex_count;
+			}
+
+			cached_vertices += section_vertex_count;
+		}
+		// NOTE: textures are loaded on first use, which requires OpenGL
+		job->texture = get_texture(assets, TEXTURE_BLOCK_ATLAS).id.value;
+		chunk->job = job - world->jobs + 1;
+
+		// NOTE: only the sections around a placed block are meshed again,
+		// which the player should see as soon as possible. Generating a
+		// chunk can take any time.
+		enum platform_task_priority priority = PLATFORM_TASK_INTERACTIVE;
+		if (job->type == CHUNK_JOB_GENERATE) {
+			priority = PLATFORM_TASK_BACKGROUND;
+		} else if (job->section_mask != CHUNK_ALL_SECTIONS) {
+			priority = PLATFORM_TASK_FRAME;
+		}
+
+		struct platform_api *platform = world->platform;
+		platform->add_task(platform->queue, priority, world_run_chunk_job, job);
+	}
+
+	return job;
+}
+
+// NOTE: the mesh of the job is outdated if a neighbour was generated at one
+// of its open borders while the job was running.
+static bool
+world_has_new_neighbors(struct world *world, struct chunk *chunk,
+    const struct chunk_job *job)
+{
+	u32 neighbor_mask = world_get_neighbor_mask(world, chunk->coord);
+	bool result = (job->open_borders & neighbor_mask) != 0;
+	return result;
+}
+
+/*
+ * NOTE: applies the results of the finished jobs to their chunks. The result
+ * is dropped if the chunk was unloaded in the meantime or if a block was
+ * placed in the chunk while it was meshed. Jobs that don't fit into the
+ * budget of this frame are finished in the next one.
+ */
+static void
+world_finish_chunk_jobs(struct world *world, struct renderer *renderer)
+{
+	for (u32 i = 0; i < MAX_CHUNK_JOB_COUNT; i++) {
+		struct chunk_job *job = &world->jobs[i];
+		if (!job->is_active || !__atomic_load_n(&job->is_done, __ATOMIC_ACQUIRE)) {
+			continue;
+		}
+
+		struct chunk *chunk = world_lookup_chunk(world, job->coord);
+		if (!chunk || chunk->job != i + 1) {
+			job->is_active = 0;
+			continue;
+		}
+
+		bool is_generated = job->type == CHUNK_JOB_GENERATE;
+		bool has_mesh = job->has_mesh;
+		if ((is_generated && !world_has_stage_budget(world, CHUNK_STAGE_GENERATE)) ||
+		    (has_mesh && !world_has_stage_budget(world, CHUNK_STAGE_UPLOAD))) {
+			continue;
+		}
+
+		job->is_active = 0;
+		chunk->job = 0;
+
+		if (is_generated) {
+			world_add_worker_cost(world, CHUNK_STAGE_GENERATE, job->generate_time);
+		}
+
+		if (has_mesh) {
+			world_add_worker_cost(world, CHUNK_STAGE_MESH, job->mesh_time);
+			if (job->section_mask == CHUNK_ALL_SECTIONS) {
+				world->meshed_chunk_count++;
+				world->hidden_face_count += job->hidden_face_count;
+			}
+		}
+
+		if (is_generated) {
+			assert(chunk->state == CHUNK_LOADING);
+			f64 start_time = get_time_sec();
+
+			struct chunk_column *column = world_lookup_column(world, job->coord);
+			if (!column->has_heights) {
+				memcpy(column->heights, job->column.heights, sizeof(column->heights));
+				column->min_height = job->column.min_height;
+				column->max_height = job->column.max_height;
+				column->has_heights = 1;
+			}
+
+			if (job->is_uniform) {
+				chunk_set_uniform(world, chunk, job->blocks[0]);
+			} else if (!chunk_pack(world, chunk, job->blocks)) {
+				chunk->state = CHUNK_UNLOADED;
+				world_queue_chunk(world, chunk);
+				continue;
+			}
+
+			memcpy(chunk->connections, job->connections, sizeof(chunk->connections));
+			chunk->has_outdated_connections = 0;
+			world_end_stage(world, CHUNK_STAGE_GENERATE, start_time);
+
+			struct unloaded_chunk *unloaded =
+			    world_find_unloaded_chunk(world, chunk->coord);
+			if (world_is_recently_unloaded(unloaded, world->stats_window)) {
+				world->regenerated_count++;
+			}
+
+			world_update_neighbors(world, chunk, job->blocks, job->is_uniform);
+
+			chunk->state = CHUNK_DIRTY;
+			if (chunk_is_hidden(world, chunk)) {
+				world_finish_hidden_chunk(world, chunk, renderer);
+			} else if (has_mesh && job->mesh_mode == world->mesh_mode &&
+			    job->lod == chunk->lod &&
+			    !world_has_new_neighbors(world, chunk, job)) {
+				start_time = get_time_sec();
+				if (world_upload_mesh(world, chunk, job, renderer)) {
+					chunk->open_borders = job->open_borders;
+					chunk->state = CHUNK_READY;
+				}
+
+				world_end_stage(world, CHUNK_STAGE_UPLOAD, start_time);
+			} else {
+				world_queue_chunk(world, chunk);
+			}
+		} else if (chunk->state == CHUNK_MESHING) {
+			if (job->has_connections) {
+				memcpy(chunk->connections, job->connections, sizeof(chunk->connections));
+				chunk->has_outdated_connections = 0;
+			}
+
+			if (world_has_new_neighbors(world, chunk, job)) {
+				world_mark_dirty(world, chunk);
+				continue;
+			}
+
+			bool is_uploaded = true;
+			if (job->mesh.vertex_count > 0 || chunk->mesh != 0) {
+				f64 start_time = get_time_sec();
+				is_uploaded = world_upload_mesh(world, chunk, job, renderer);
+				world_end_stage(world, CHUNK_STAGE_UPLOAD, start_time);
+			} else {
+				world_cache_mesh(world, chunk, job);
+			}
+
+			if (is_uploaded) {
+				chunk->open_borders = job->open_borders;
+				chunk->state = CHUNK_READY;
+			}
+		}
+	}
+}
+
+// NOTE: the center of the chunk has to be relative to the camera
+static bool
+chunk_is_outside_frustum(v3 center, const v4 *planes, const f32 *plane_radius)
+{
+	for (u32 i = 0; i < 6; i++) {
+		f32 distance = center.x * planes[i].x + center.y * planes[i].y +
+		    center.z * planes[i].z + planes[i].w + plane_radius[i];
+		if (distance < 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// NOTE: returns the squared distance of the camera to the closest point of
+// the chunk, the center of the chunk has to be relative to the camera.
+static f32
+chunk_get_distance_sq(v3 center)
+{
+	v3 half_dim = v3(BLOCK_COUNT_X / 2, BLOCK_COUNT_Y / 2, BLOCK_COUNT_Z / 2);
+	f32 dx = MAX(fabsf(center.x) - half_dim.x, 0);
+	f32 dy = MAX(fabsf(center.y) - half_dim.y, 0);
+	f32 dz = MAX(fabsf(center.z) - half_dim.z, 0);
+
+	f32 result = dx * dx + dy * dy + dz * dz;
+	return result;
+}
+
+// NOTE: the vertices of a mesh are the corners of the blocks, which are
+// offset by half a block from their centers.
+static v3
+chunk_get_center(const struct chunk *chunk, v3 camera_pos)
+{
+	v3 center = v3(
+	    (chunk->coord.x + 0.5f) * BLOCK_COUNT_X - 0.5f - camera_pos.x,
+	    (chunk->coord.y + 0.5f) * BLOCK_COUNT_Y - 0.5f - camera_pos.y,
+	    (chunk->coord.z + 0.5f) * BLOCK_COUNT_Z - 0.5f - camera_pos.z);
+
+	return center;
+}
+
+/*
+ * NOTE: searches the chunks that can be seen from the chunk of the camera.
+ * The search leaves a chunk only through the borders that are connected to
+ * the border through which it entered the chunk. It never goes back in a
+ * direction that it already went in, so it doesn't find chunks that can only
+ * be seen around corners. Chunks outside of the view frustum or behind the
+ * fog are not entered. A chunk is entered again through each of its borders,
+ * since the first border doesn't have to connect to all the others. Returns
+ * false if the camera is outside of the resident chunks.
+ */
+static bool
+world_find_visible_chunks(struct world *world, v3 camera_pos,
+    const v4 *planes, const f32 *plane_radius)
+{
+	struct chunk *camera_chunk = world_get_chunk(world,
+	    camera_pos.x + 0.5f, camera_pos.y + 0.5f, camera_pos.z + 0.5f);
+	if (!camera_chunk) {
+		return false;
+	}
+
+	u32 frame = ++world->visit_frame;
+	struct chunk_visit *queue = world->visit_queue;
+	u32 queue_start = 0;
+	u32 queue_end = 0;
+
+	// NOTE: the chunk of the camera can be left through every border
+	camera_chunk->visit_frame = frame;
+	camera_chunk->visited_borders = (1 << CHUNK_BORDER_COUNT) - 1;
+	queue[queue_end].chunk = camera_chunk - world->chunks;
+	queue[queue_end].border = CHUNK_BORDER_COUNT;
+	queue[queue_end].directions = 0;
+	queue_end++;
+
+	f32 fog_distance_sq = FOG_DISTANCE * FOG_DISTANCE;
+	while (queue_start < queue_end) {
+		struct chunk_visit visit = queue[queue_start++];
+		struct chunk *chunk = &world->chunks[visit.chunk];
+
+		u32 borders = (1 << CHUNK_BORDER_COUNT) - 1;
+		if (visit.border < CHUNK_BORDER_COUNT) {
+			borders = chunk->connections[visit.border];
+		}
+
+		for (u32 border = 0; border < CHUNK_BORDER_COUNT; border++) {
+			u32 opposite = border ^ 1;
+			if (!(borders & (1 << border)) || (visit.directions & (1 << opposite))) {
+				continue;
+			}
+
+			struct chunk *neighbor = world_lookup_adjacent(world, chunk->coord, border);
+			if (!neighbor) {
+				continue;
+			}
+
+			bool is_visited = neighbor->visit_frame == frame;
+			if (is_visited && (neighbor->visited_borders & (1 << opposite))) {
+				continue;
+			}
+
+			v3 center = chunk_get_center(neighbor, camera_pos);
+			if (chunk_is_outside_frustum(center, planes, plane_radius) ||
+			    chunk_get_distance_sq(center) >= fog_distance_sq) {
+				continue;
+			}
+
+			if (!is_visited) {
+				neighbor->visit_frame = frame;
+				neighbor->visited_borders = 0;
+			}
+
+			neighbor->visited_borders |= 1 << opposite;
+			assert(queue_end < CHUNK_BORDER_COUNT * world->max_chunk_count);
+			queue[queue_end].chunk = neighbor - world->chunks;
+			queue[queue_end].border = opposite;
+			queue[queue_end].directions = visit.directions | (1 << border);
+			queue_end++;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * NOTE: culls a batch of chunks against the planes of the view frustum and
+ * the fog distance. The planes have to be relative to the camera. Returns the
+ * mask of the chunks that are outside of the frustum, the fog mask contains
+ * the chunks that are too far away.
+ */
+static u32
+world_cull_batch(const struct chunk_cull_batch *batch, const v4 *planes,
+    const f32 *plane_radius, f32 fog_distance, u32 *fog_mask)
+{
+	u32 frustum_mask = 0;
+	*fog_mask = 0;
+
+#if WORLD_SSE2
+	const v3 half_dim = v3(BLOCK_COUNT_X / 2, BLOCK_COUNT_Y / 2, BLOCK_COUNT_Z / 2);
+	__m128 x = _mm_loadu_ps(batch->x);
+	__m128 y = _mm_loadu_ps(batch->y);
+	__m128 z = _mm_loadu_ps(batch->z);
+	__m128 zero = _mm_setzero_ps();
+
+	// NOTE: a box is outside if its corner closest to the inside of a
+	// plane is still outside.
+	__m128 outside = zero;
+	for (u32 i = 0; i < 6; i++) {
+		__m128 distance = _mm_mul_ps(x, _mm_set1_ps(planes[i].x));
+		distance = _mm_add_ps(distance, _mm_mul_ps(y, _mm_set1_ps(planes[i].y)));
+		distance = _mm_add_ps(distance, _mm_mul_ps(z, _mm_set1_ps(planes[i].z)));
+		distance = _mm_add_ps(distance, _mm_set1_ps(planes[i].w + plane_radius[i]));
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+	}
+
+	__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 dx = _mm_max_ps(_mm_sub_ps(_mm_and_ps(x, abs_mask), _mm_set1_ps(half_dim.x)), zero);
+	__m128 dy = _mm_max_ps(_mm_sub_ps(_mm_and_ps(y, abs_mask), _mm_set1_ps(half_dim.y)), zero);
+	__m128 dz = _mm_max_ps(_mm_sub_ps(_mm_and_ps(z, abs_mask), _mm_set1_ps(half_dim.z)), zero);
+	__m128 distance_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx),
+	    _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+	__m128 is_fogged = _mm_cmpge_ps(distance_sq, _mm_set1_ps(fog_distance * fog_distance));
+
+	frustum_mask = _mm_movemask_ps(outside);
+	*fog_mask = _mm_movemask_ps(is_fogged);
+#else
+	for (u32 j = 0; j < 4; j++) {
+		v3 center = v3(batch->x[j], batch->y[j], batch->z[j]);
+		if (chunk_is_outside_frustum(center, planes, plane_radius)) {
+			frustum_mask |= 1 << j;
+		}
+
+		if (chunk_get_distance_sq(center) >= fog_distance * fog_distance) {
+			*fog_mask |= 1 << j;
+		}
+	}
+#endif
+
+	return frustum_mask;
+}
+
+/*
+ * NOTE: draws the chunks with meshes that are visible from the camera, inside
+ * of the view frustum and closer than the fog distance. Chunks keep their old
+ * mesh until the new one is uploaded.
+ */
+static void
+world_draw_chunks(struct world *world, struct render_cmdbuf *cmd_buffer,
+    struct texture_id texture)
+{
+	struct render_transform *transform = &cmd_buffer->transform;
+	v3 camera_pos = transform->camera_pos;
+	v3 half_dim = v3(BLOCK_COUNT_X / 2, BLOCK_COUNT_Y / 2, BLOCK_COUNT_Z / 2);
+
+	v4 planes[6];
+	f32 plane_radius[6];
+	m4x4_frustum_planes(m4x4_mul(transform->projection, transform->view), planes);
+	for (u32 i = 0; i < 6; i++) {
+		v3 normal = v3(planes[i].x, planes[i].y, planes[i].z);
+		planes[i].w += dot(normal, camera_pos);
+		plane_radius[i] = fabsf(normal.x) * half_dim.x +
+		    fabsf(normal.y) * half_dim.y + fabsf(normal.z) * half_dim.z;
+	}
+
+	bool is_searched = world->is_occlusion_culling_enabled &&
+	    world_find_visible_chunks(world, camera_pos, planes, plane_radius);
+
+	world->occluded_chunk_count = 0;
+
+	u32 chunk_count = 0;
+	struct chunk_cull_batch *batches = world->cull_batches;
+	for (u32 i = 0; i < world->chunk_count; i++) {
+		struct chunk *chunk = &world->chunks[i];
+		if (chunk->mesh == 0) {
+			continue;
+		}
+
+		if (is_searched && chunk->visit_frame != world->visit_frame) {
+			world->occluded_chunk_count++;
+			continue;
+		}
+
+		struct chunk_cull_batch *batch = &batches[chunk_count / 4];
+		u32 j = chunk_count % 4;
+		v3 center = chunk_get_center(chunk, camera_pos);
+		batch->x[j] = center.x;
+		batch->y[j] = center.y;
+		batch->z[j] = center.z;
+		batch->chunk[j] = i + 1;
+		chunk_count++;
+	}
+
+	for (u32 j = chunk_count % 4; j != 0 && j < 4; j++) {
+		struct chunk_cull_batch *batch = &batches[chunk_count / 4];
+		batch->x[j] = batch->y[j] = batch->z[j] = 0;
+		batch->chunk[j] = 0;
+	}
+
+	world->drawn_chunk_count = 0;
+	world->frustum_culled_chunk_count = 0;
+	world->fog_culled_chunk_count = 0;
+
+	u32 batch_count = (chunk_count + 3) / 4;
+	for (u32 i = 0; i < batch_count; i++) {
+		struct chunk_cull_batch *batch = &batches[i];
+		u32 used_mask = 0xf;
+		if (i == batch_count - 1 && chunk_count % 4 != 0) {
+			used_mask = (1 << (chunk_count % 4)) - 1;
+		}
+
+		u32 fog_mask;
+		u32 frustum_mask = world_cull_batch(batch, planes, plane_radius,
+		    FOG_DISTANCE, &fog_mask) & used_mask;
+		fog_mask &= used_mask & ~frustum_mask;
+		u32 visible_mask = used_mask & ~(frustum_mask | fog_mask);
+
+		world->frustum_culled_chunk_count += __builtin_popcount(frustum_mask);
+		world->fog_culled_chunk_count += __builtin_popcount(fog_mask);
+		world->drawn_chunk_count += __builtin_popcount(visible_mask);
+
+		while (visible_mask) {
+			u32 j = __builtin_ctz(visible_mask);
+			visible_mask &= visible_mask - 1;
+
+			struct chunk *chunk = &world->chunks[batch->chunk[j] - 1];
+			v3 chunk_pos = v3(chunk->coord.x * BLOCK_COUNT_X - 0.5f,
+			    chunk->coord.y * BLOCK_COUNT_Y - 0.5f,
+			    chunk->coord.z * BLOCK_COUNT_Z - 0.5f);
+			render_mesh(cmd_buffer, chunk->mesh, chunk_pos, texture);
+		}
+	}
+}
+
+static void
+world_update(struct world *world, v3 player_pos, v3 player_dir,
+    struct renderer *renderer, struct render_cmdbuf *cmd_buffer,
+    struct game_assets *assets)
+{
+	world_begin_stages(world);
+	world_finish_chunk_jobs(world, renderer);
+
+	f64 time = get_time_sec();
+	if (time - world->stats_window_start >= 60.0) {
+		world->regenerated_per_minute = world->regenerated_count;
+		world->regenerated_count = 0;
+		world->stats_window++;
+		world->stats_window_start = time;
+	}
+
+	i32 view_distance = world->view_distance;
+	i32 unload_distance = world->unload_distance;
+	world->load_pos = player_pos;
+	world->load_dir = player_dir;
+
+	v3i load_center;
+	load_center.x = floor(player_pos.x / BLOCK_COUNT_X);
+	load_center.y = floor(player_pos.y / BLOCK_COUNT_Y);
+	load_center.z = floor(player_pos.z / BLOCK_COUNT_Z);
+
+	// NOTE: chunks at any distance are meshed again once the meshes use less
+	// than three quarters of their budget.
+	bool is_mesh_distance_reset = false;
+	if (world->mesh_distance_sq != F32_INF &&
+	    renderer_get_mesh_memory(renderer) < renderer->mesh_memory_budget / 4 * 3) {
+		world->mesh_distance_sq = F32_INF;
+		is_mesh_distance_reset = true;
+	}
+
+	// NOTE: the resident chunks only depend on the position of the player
+	// and only change when the player moves to another chunk.
+	if (!v3i_equals(load_center, world->load_center) ||
+	    view_distance != world->loaded_view_distance) {
+		world->load_center = load_center;
+		world->loaded_view_distance = view_distance;
+
+		// NOTE: unload any chunks that are outside the unload distance
+		for (u32 i = world->chunk_count; i-- > 0;) {
+			struct chunk *chunk = &world->chunks[i];
+			v3i offset = sub(chunk->coord, load_center);
+			if (abs(offset.x) > unload_distance ||
+			    abs(offset.y) > unload_distance ||
+			    abs(offset.z) > unload_distance) {
+				world_remove_chunk(world, chunk, renderer);
+			}
+		}
+
+		v3i player_offset = sub(load_center,
+		    v3i(view_distance, view_distance, view_distance));
+
+		i32 load_size = 2 * view_distance + 1;
+		i32 load_count = load_size * load_size * load_size;
+		for (i32 i = 0; i < load_count; i++) {
+			v3i chunk_offset;
+			chunk_offset.x = i % load_size;
+			chunk_offset.y = i / load_size % load_size;
+			chunk_offset.z = i / load_size / load_size;
+
+			v3i chunk_coord = add(player_offset, chunk_offset);
+			if (!world_lookup_chunk(world, chunk_coord)) {
+				world_add_chunk(world, chunk_coord);
+			}
+		}
+
+		world_update_lods(world);
+		world->queue_dir = player_dir;
+		world_rebuild_queue(world);
+	} else if (dot(player_dir, world->queue_dir) < 0.9f ||
+	    is_mesh_distance_reset) {
+		world->queue_dir = player_dir;
+		world_rebuild_queue(world);
+	}
+
+	// NOTE: generating and meshing the chunks is done by the worker threads,
+	// only hidden chunks are finished right away.
+	while (world->load_queue_count > 0) {
+		struct chunk *chunk = world_lookup_chunk(world, world->load_queue[0].coord);
+		assert(chunk);
+		assert(chunk->state == CHUNK_UNLOADED || chunk->state == CHUNK_DIRTY);
+
+		enum chunk_stage stage = CHUNK_STAGE_MESH;
+		if (chunk->state == CHUNK_UNLOADED) {
+			stage = CHUNK_STAGE_GENERATE;
+		}
+
+		if (!world_has_stage_budget(world, stage)) {
+			break;
+		}
+
+		bool is_hidden = chunk->state == CHUNK_DIRTY && chunk_is_hidden(world, chunk);
+		if (chunk->state == CHUNK_DIRTY && !is_hidden &&
+		    length_sq(world_get_chunk_offset(world, chunk->coord)) >=
+		    world->mesh_distance_sq) {
+			world_evict_chunk(world, chunk, renderer);
+			world_pop_queue(world);
+			continue;
+		}
+
+		if (chunk->state == CHUNK_DIRTY && !is_hidden &&
+		    world_has_pending_neighbors(world, chunk->coord)) {
+			chunk->state = CHUNK_WAITING;
+			world_pop_queue(world);
+			continue;
+		}
+
+		f64 start_time = get_time_sec();
+		if (is_hidden) {
+			world_finish_hidden_chunk(world, chunk, renderer);
+		} else if (!world_start_chunk_job(world, chunk, assets)) {
+			break;
+		}
+
+		world_end_stage(world, stage, start_time);
+		world_pop_queue(world);
+	}
+
+	world_evict_meshes(world, renderer);
+
+	struct texture_id texture = get_texture(assets, TEXTURE_BLOCK_ATLAS).id;
+	world_draw_chunks(world, cmd_buffer, texture);
+}
+
+/*
+ * NOTE: returns the sections of the chunk whose meshes depend on a block in
+ * the layer of the chunk. The faces next to the block are part of the
+ * sections of the blocks above and below it. The cells of downsampled chunks
+ * depend on all of their blocks, but they never cross a section.
+ */
+static u32
+chunk_get_sections(const struct chunk *chunk, i32 y)
+{
+	static_assert(CHUNK_SECTION_HEIGHT >= (1 << (CHUNK_LOD_COUNT - 1)),
+	    "The cells of downsampled chunks must fit into a section");
+
+	i32 cell_size = 1 << chunk->lod;
+	i32 first_y = MAX((y & ~(cell_size - 1)) - 1, 0);
+	i32 last_y = MIN((y | (cell_size - 1)) + 1, BLOCK_COUNT_Y - 1);
+
+	u32 first = first_y / CHUNK_SECTION_HEIGHT;
+	u32 last = last_y / CHUNK_SECTION_HEIGHT;
+	u32 section_mask = ((2 << last) - 1) & ~((1 << first) - 1);
+	return section_mask;
+}
+
+/*
+ * NOTE: only the sections around the block are meshed again. The neighbours
+ * only cull their faces against the block if it is at their border and they
+ * only depend on whether the block is empty or water, except for downsampled
+ * neighbours, whose skirts use the texture of the block.
+ */
+static void
+world_place_block(struct world *world, f32 x, f32 y, f32 z,
+    enum block_type block_type)
+{
+	struct chunk *chunk = world_get_chunk(world, x, y, z);
+	if (chunk && chunk->palette_count > 0) {
+		v3 block_pos = world_get_block_pos(world, x, y, z);
+		v3i block = v3i_vec3(v3_floor(block_pos));
+
+		u32 i = block_index(block.x, block.y, block.z);
+		u32 old_block_type = chunk_at(chunk, block.x, block.y, block.z);
+		if (old_block_type == block_type ||
+		    !chunk_set_block(world, chunk, i, block_type)) {
+			return;
+		}
+
+		// NOTE: removing a block can connect the borders of the chunk, which
+		// is only known once the chunk was meshed again.
+		if (block_is_empty(block_type)) {
+			chunk_connect_all_borders(chunk);
+			chunk->has_outdated_connections = 1;
+		}
+
+		world_mark_sections_dirty(world, chunk, chunk_get_sections(chunk, block.y));
+
+		bool is_culling_changed =
+		    block_is_empty(old_block_type) != block_is_empty(block_type) ||
+		    (old_block_type == BLOCK_WATER) != (block_type == BLOCK_WATER);
+
+		for (u32 border = 0; border < CHUNK_BORDER_COUNT; border++) {
+			u32 axis = border / 2;
+			i32 border_pos = border & 1 ? 0 : BLOCK_COUNT_X - 1;
+			if (block.e[axis] != border_pos) {
+				continue;
+			}
+
+			struct chunk *neighbor = world_lookup_neighbor(world, chunk->coord, border);
+			if (!neighbor || neighbor->palette_count == 0 ||
+			    (!is_culling_changed && neighbor->lod == 0)) {
+				continue;
+			}
+
+			// NOTE: the neighbour only depends on the block through the faces
+			// of its blocks at the border.
+			i32 neighbor_y = block.y;
+			if (axis == 1) {
+				neighbor_y = border & 1 ? BLOCK_COUNT_Y - 1 : 0;
+			}
+
+			// NOTE: neighbours that are dirty or waiting are already queued,
+			// but they would splice the cached border section back in.
+			u32 section_mask = 1 << (neighbor_y / CHUNK_SECTION_HEIGHT);
+			if (neighbor->state == CHUNK_READY || neighbor->state == CHUNK_MESHING) {
+				world_mark_sections_dirty(world, neighbor, section_mask);
+			} else {
+				neighbor->dirty_sections |= section_mask;
+			}
 		}
 	}
 }
@@ -1,9 +1,28 @@
-#define MAX_LOAD_PER_FRAME 8
+#define MAX_CHUNK_JOB_COUNT 16
 
-#define CHUNK_COUNT_X 16
-#define CHUNK_COUNT_Y 16
-#define CHUNK_COUNT_Z 16
-#define CHUNK_COUNT (CHUNK_COUNT_X * CHUNK_COUNT_Y * CHUNK_COUNT_Z)
+// NOTE: the time in milliseconds that the main thread spends on each stage
+// of the chunk pipeline per frame.
+#define DEFAULT_GENERATE_BUDGET 1.0f
+#define DEFAULT_MESH_BUDGET 1.0f
+#define DEFAULT_UPLOAD_BUDGET 2.0f
+
+// NOTE: the view distance is the number of chunks that are loaded in each
+// direction around the player.
+#define DEFAULT_VIEW_DISTANCE 8
+#define MAX_VIEW_DISTANCE 16
+
+// NOTE: chunks are only unloaded once they are a quarter view distance
+// farther away than the loaded chunks, so that moving back and forth across
+// a chunk border doesn't unload and generate the same chunks again.
+#define UNLOAD_DISTANCE(view_distance) \
+    ((view_distance) + MAX(1, (view_distance) / 4))
+#define MAX_CHUNK_COUNT_AXIS (2 * UNLOAD_DISTANCE(MAX_VIEW_DISTANCE) + 1)
+#define MAX_CHUNK_COUNT \
+    (MAX_CHUNK_COUNT_AXIS * MAX_CHUNK_COUNT_AXIS * MAX_CHUNK_COUNT_AXIS)
+#define CHUNK_TABLE_SIZE (1 << 18)
+#define MAX_COLUMN_COUNT (MAX_CHUNK_COUNT_AXIS * MAX_CHUNK_COUNT_AXIS)
+#define COLUMN_TABLE_SIZE (1 << 12)
+#define UNLOADED_TABLE_SIZE (1 << 14)
 
 #define BLOCK_EXP 4
 
@@ -12,22 +31,351 @@
 #define BLOCK_COUNT_Y (1 << BLOCK_EXP)
 #define BLOCK_COUNT_Z (1 << BLOCK_EXP)
 #define BLOCK_COUNT (BLOCK_COUNT_X * BLOCK_COUNT_Y * BLOCK_COUNT_Z)
+#define CHUNK_BORDER_SIZE (BLOCK_COUNT_X * BLOCK_COUNT_X)
+
+/*
+ * NOTE: the mesh of a chunk is generated in sections of a few layers of
+ * blocks, so that placing a block only meshes the sections around it again.
+ * The meshes of the sections are cached, the cache size is in bytes.
+ */
+#define CHUNK_SECTION_HEIGHT 4
+#define CHUNK_SECTION_COUNT (BLOCK_COUNT_Y / CHUNK_SECTION_HEIGHT)
+#define CHUNK_SECTION_SIZE (BLOCK_COUNT_X * CHUNK_SECTION_HEIGHT * BLOCK_COUNT_Z)
+#define CHUNK_ALL_SECTIONS ((1 << CHUNK_SECTION_COUNT) - 1)
+#define CHUNK_CACHE_SIZE MB(8)
+
+// NOTE: the palette can hold every block type, so chunks never need more
+// than eight bits per block.
+#define CHUNK_PALETTE_SIZE 32
+#define CHUNK_SIZE_CLASS_COUNT 4
+
+/*
+ * NOTE: chunks are meshed from downsampled blocks once they are farther away
+ * than the distance of a level. Each level halves the resolution of the
+ * blocks. A chunk only switches to another level once it is more than the
+ * hysteresis past the distance of the level, so that moving back and forth
+ * doesn't mesh the same chunks again. The distances are in blocks.
+ */
+#define CHUNK_LOD_COUNT 3
+#define CHUNK_LOD_DISTANCE 64
+#define CHUNK_LOD_HYSTERESIS 8
+
+// NOTE: the borders are in the same order as the faces of a block
+enum chunk_border {
+	CHUNK_BORDER_RIGHT,
+	CHUNK_BORDER_LEFT,
+	CHUNK_BORDER_TOP,
+	CHUNK_BORDER_BOTTOM,
+	CHUNK_BORDER_FRONT,
+	CHUNK_BORDER_BACK,
+	CHUNK_BORDER_COUNT
+};
 
+/*
+ * NOTE: a chunk is loading while its blocks are generated on a worker thread
+ * and meshing while its mesh is generated. A chunk is dirty if the mesh has
+ * not been generated for its current blocks yet. A dirty chunk is waiting
+ * while some of its neighbours are still being generated, it is only meshed
+ * once it can be culled against all of them. A chunk is evicted if its mesh
+ * was freed to stay within the memory budget of the meshes, it is only meshed
+ * again once the player gets closer to it.
+ */
 enum chunk_state {
 	CHUNK_UNLOADED,
-	// NOTE: a chunk is dirty if the mesh has not been generated for it yet
 	CHUNK_DIRTY,
+	CHUNK_WAITING,
 	CHUNK_LOADING,
+	CHUNK_MESHING,
 	CHUNK_READY,
+	CHUNK_EVICTED,
 };
 
+/*
+ * NOTE: the blocks of a chunk are stored as indices into the palette of the
+ * chunk. The indices are packed into words with one, two, four or eight bits
+ * per block and the storage is widened once the palette is full. A chunk
+ * without a palette has not been generated yet. The job is the index of the
+ * running job plus one. The open borders are the borders with visible faces
+ * towards neighbours that were not generated when the chunk was meshed.
+ *
+ * The connections contain a mask of the borders for each border that can be
+ * reached from it through empty blocks. Chunks that were not generated yet
+ * connect all of their borders. The visited borders are the borders through
+ * which the chunk was entered during the last visibility search, they are
+ * only valid if the visit frame is the frame of the search. Placing a block
+ * can only disconnect borders, so the connections are only outdated once a
+ * block was removed. The level of
+ * detail is the level at which the chunk is meshed.
+ *
+ * The cached mesh contains the vertices of the sections in order, followed
+ * by unused vertices up to the capacity. The dirty sections are the sections
+ * whose cached mesh is outdated, all sections are dirty while the chunk has
+ * no cached mesh.
+ */
 struct chunk {
 	u32 state;
 	u32 mesh;
-	u16 *blocks;
+	u32 *indices;
+	v3i coord;
+	u32 visit_frame;
+	u8 bits_per_block;
+	u8 palette_count;
+	u8 palette[CHUNK_PALETTE_SIZE];
+	u8 open_borders;
+	u8 connections[CHUNK_BORDER_COUNT];
+	u8 has_outdated_connections;
+	u8 visited_borders;
+	u8 lod;
+	u16 job;
+	u8 dirty_sections;
+	u8 section_borders[CHUNK_SECTION_COUNT];
+	u16 section_vertex_counts[CHUNK_SECTION_COUNT];
+	u32 cache_offset;
+	u32 cache_capacity;
+};
+
+/*
+ * NOTE: a column caches the terrain height of every block column in a stack
+ * of chunks. The heights are only computed when the first chunk of the
+ * column is generated and the column is removed with its last resident
+ * chunk. The coordinate is the chunk coordinate with y set to zero.
+ */
+struct chunk_column {
 	v3i coord;
+	u32 chunk_count;
+	u32 has_heights;
+	f32 min_height;
+	f32 max_height;
+	f32 heights[BLOCK_COUNT_X][BLOCK_COUNT_Z];
+};
+
+/*
+ * NOTE: the naive mesher emits one quad for each visible face of a block, the
+ * greedy mesher merges the visible faces of the same block in each slice of
+ * the chunk into rectangles.
+ */
+enum chunk_mesh_mode {
+	CHUNK_MESH_NAIVE,
+	CHUNK_MESH_GREEDY,
 };
 
+/*
+ * NOTE: both meshers find the visible faces of a section with bitmasks. Each
+ * mask is a row of blocks along the x axis with one bit per block. The
+ * lowered mask contains the water blocks with a lowered top face. The hidden
+ * border count is the number of faces at the borders of the chunk that are
+ * hidden by the blocks of the neighbours.
+ */
+struct chunk_face_masks {
+	u16 visible[CHUNK_BORDER_COUNT][BLOCK_COUNT_Z][CHUNK_SECTION_HEIGHT];
+	u16 lowered[BLOCK_COUNT_Z][CHUNK_SECTION_HEIGHT];
+	u32 hidden_border_count;
+};
+
+enum chunk_job_type {
+	CHUNK_JOB_GENERATE,
+	CHUNK_JOB_MESH,
+};
+
+/*
+ * NOTE: a job generates or meshes a chunk on a worker thread. The worker only
+ * reads and writes the job itself, the chunk is updated on the main thread
+ * once the job is done. Generating a chunk also meshes it, unless the chunk
+ * is uniform. The column contains a copy of the terrain heights, which are
+ * computed by the job if the column did not have them yet. The borders
+ * contain the blocks of the neighbours next to the chunk, the neighbour mask
+ * has a bit for each neighbour that was generated. Chunks are not meshed
+ * while they are generated if some of their neighbours are still missing.
+ * The blocks are downsampled before meshing if the level of detail is not
+ * zero. Only the sections in the section mask are meshed, the other sections
+ * are copied from the cache into the mesh before the job is started. The
+ * sections can be in any order in the mesh. The connections are only
+ * computed if the chunk is generated, if all sections are meshed or if the
+ * connections of the chunk are outdated.
+ */
+struct chunk_job {
+	u32 type;
+	u32 is_active;
+	u32 is_done;
+	u32 is_uniform;
+	u32 has_mesh;
+	u32 mesh_mode;
+	u32 lod;
+	f32 generate_time;
+	f32 mesh_time;
+	u32 hidden_face_count;
+	v3i coord;
+	struct chunk_column column;
+	u16 blocks[BLOCK_COUNT];
+	u16 borders[CHUNK_BORDER_COUNT][CHUNK_BORDER_SIZE];
+	u32 neighbor_mask;
+	u32 open_borders;
+	u32 has_connections;
+	u8 connections[CHUNK_BORDER_COUNT];
+	u32 texture;
+	struct mesh_buffer mesh;
+	u32 section_mask;
+	u32 section_offsets[CHUNK_SECTION_COUNT];
+	u32 section_vertex_counts[CHUNK_SECTION_COUNT];
+	u8 section_borders[CHUNK_SECTION_COUNT];
+};
+
+struct chunk_queue_entry {
+	f32 priority;
+	v3i coord;
+};
+
+enum chunk_stage {
+	CHUNK_STAGE_GENERATE,
+	CHUNK_STAGE_MESH,
+	CHUNK_STAGE_UPLOAD,
+	CHUNK_STAGE_COUNT
+};
+
+/*
+ * NOTE: the main thread spends at most the budget of each stage per frame,
+ * but always processes at least one chunk. The number of chunks per frame is
+ * limited by the budget divided by the average cost of a chunk. The cost is
+ * the time that the main thread spends on a chunk and the worker cost is the
+ * time that a worker thread spends on it. All times are in milliseconds.
+ */
+struct chunk_stage_stats {
+	f32 budget;
+	f32 cost;
+	f32 worker_cost;
+	f32 time;
+	u32 count;
+	u32 limit;
+};
+
+/*
+ * NOTE: the centers of four chunks relative to the camera for culling them
+ * at once. Unused entries have a chunk index of zero, the other entries
+ * contain the chunk index plus one.
+ */
+struct chunk_cull_batch {
+	f32 x[4];
+	f32 y[4];
+	f32 z[4];
+	u32 chunk[4];
+};
+
+/*
+ * NOTE: a chunk that the visibility search entered through a border. The
+ * directions contain a bit for each border that the search crossed on its
+ * way to the chunk.
+ */
+struct chunk_visit {
+	u32 chunk;
+	u8 border;
+	u8 directions;
+};
+
+// NOTE: a zero window marks an empty entry
+struct unloaded_chunk {
+	v3i coord;
+	u32 window;
+};
+
+/*
+ * NOTE: the resident chunks are stored densely in the chunks array and are
+ * found by their coordinate through an open addressing hash table. Removing a
+ * chunk swaps it with the last resident chunk and frees its mesh. The index
+ * storage of the chunks is allocated from the arena and kept in one free list
+ * for each size class.
+ */
 struct world {
+	struct arena *arena;
+	struct platform_api *platform;
 	struct chunk *chunks;
+	u32 chunk_count;
+	u32 max_chunk_count;
+
+	// NOTE: contains the chunk index plus one, zero means the slot is empty
+	u32 *chunk_table;
+	u32 chunk_table_size;
+
+	struct chunk_column *columns;
+	u32 column_count;
+	u32 *column_table;
+	u32 column_table_size;
+
+	struct chunk_job *jobs;
+	u32 mesh_mode;
+
+	// NOTE: the cached meshes of the chunks, the sizes are in vertices
+	struct mesh_vertex *cache;
+	struct mesh_allocator cache_allocator;
+
+	// NOTE: the levels of detail of the chunks are only updated when the
+	// player moves to another chunk.
+	bool is_lod_enabled;
+
+	/*
+	 * NOTE: the load queue is a binary min-heap of the chunks that need to
+	 * be generated or meshed, ordered by their distance to the player.
+	 * Chunks behind the camera are treated as if they were farther away.
+	 * Every unloaded or dirty chunk is in the queue exactly once. The queue
+	 * is only rebuilt when the player moves to another chunk or turns
+	 * around.
+	 */
+	struct chunk_queue_entry *load_queue;
+	u32 load_queue_count;
+	struct chunk_stage_stats stages[CHUNK_STAGE_COUNT];
+
+	/*
+	 * NOTE: the squared distance of the nearest chunk whose mesh was
+	 * evicted. Chunks at this distance or farther are not meshed, until
+	 * enough memory of the meshes is freed again.
+	 */
+	f32 mesh_distance_sq;
+	u32 evicted_mesh_count;
+
+	/*
+	 * NOTE: chunks are only drawn if they can be seen from the chunk of
+	 * the camera through the empty blocks of the chunks in between. The
+	 * counts are the number of chunks with meshes that were drawn or culled
+	 * in the last frame, occluded chunks were not reached by the search.
+	 */
+	struct chunk_cull_batch *cull_batches;
+	struct chunk_visit *visit_queue;
+	u32 visit_frame;
+	bool is_occlusion_culling_enabled;
+	u32 drawn_chunk_count;
+	u32 occluded_chunk_count;
+	u32 frustum_culled_chunk_count;
+	u32 fog_culled_chunk_count;
+
+	v3 load_pos;
+	v3 load_dir;
+	v3 queue_dir;
+	v3i load_center;
+	i32 loaded_view_distance;
+
+	/*
+	 * NOTE: chunks that were unloaded during the current or the previous
+	 * minute are remembered, so that the chunks that are generated again
+	 * can be counted. The count of the last full minute is kept in
+	 * regenerated_per_minute.
+	 */
+	struct unloaded_chunk *unloaded_chunks;
+	u32 unloaded_chunk_count;
+	u32 stats_window;
+	f64 stats_window_start;
+	u32 regenerated_count;
+	u32 regenerated_per_minute;
+
+	/*
+	 * NOTE: the number of chunks whose sections were all meshed and the
+	 * number of faces at their borders that were hidden by the blocks of
+	 * their neighbours.
+	 */
+	u32 meshed_chunk_count;
+	u64 hidden_face_count;
+
+	u32 *free_indices[CHUNK_SIZE_CLASS_COUNT];
+	usize block_memory;
+	usize used_block_memory;
+	i32 view_distance;
+	i32 unload_distance;
 };
@@ -218,12 +218,18 @@ x11_poll_events(struct x11_state *state, struct game_input *input,
 			xkb_keycode_t keycode;
 			u8 *pressed;
 		} keys_to_check[] = {
-			{ 65, &input->controller.jump             },
-			{ 25, &input->controller.move_up          },
-			{ 26, &input->controller.toggle_inventory },
-			{ 38, &input->controller.move_left        },
-			{ 39, &input->controller.move_down        },
-			{ 40, &input->controller.move_right       },
+			{ 65, &input->controller.jump                   },
+			{ 25, &input->controller.move_up                },
+			{ 26, &input->controller.toggle_inventory       },
+			{ 38, &input->controller.move_left              },
+			{ 39, &input->controller.move_down              },
+			{ 40, &input->controller.move_right             },
+			{ 58, &input->controller.toggle_mesh_mode       },
+			{ 20, &input->controller.decrease_view_distance },
+			{ 21, &input->controller.increase_view_distance },
+			{ 34, &input->controller.decrease_load_budget   },
+			{ 35, &input->controller.increase_load_budget   },
+			{ 69, &input->controller.toggle_stats           },
 		};
 
 		xcb_query_keymap_cookie_t cookie = xcb_query_keymap(connection);
@@ -377,6 +383,7 @@ x11_main(struct game_code *game, struct platform_memory *compositor_memory,
 	f64 target_frame_time = 1.0f / 60.0f;
 	while (x11.is_open) {
 		f64 start_time = get_time_sec();
+		task_queue_begin_frame(game->memory.platform->queue);
 
 		events.count = 0;
 		x11_poll_events(&x11, &input, &events);